@@ -0,0 +1,205 @@
+#include <QDateTime>
+#include "capture.h"
+#include "logger.h"
+
+Capture::Capture(const QString &fileName, qint64 size, QObject *parent) : QObject(parent), m_file(fileName), m_size(size)
+{
+    if (!open())
+        return;
+
+    logInfo << "Capturing MQTT traffic to" << fileName;
+}
+
+Capture::~Capture(void)
+{
+    if (!m_file.isOpen())
+        return;
+
+    m_file.close();
+}
+
+void Capture::record(Type type, const QString &topic, const QByteArray &message)
+{
+    if (!m_file.isOpen())
+        return;
+
+    if (m_size > 0 && m_file.size() >= m_size)
+        rotate();
+
+    if (!m_file.isOpen())
+        return;
+
+    m_stream << static_cast <quint8> (type) << QDateTime::currentMSecsSinceEpoch() << topic.toUtf8() << message;
+}
+
+bool Capture::open(void)
+{
+    if (!m_file.open(QFile::WriteOnly | QFile::Append))
+    {
+        logWarning << "Capture file" << m_file.fileName() << "open failed";
+        return false;
+    }
+
+    m_stream.setDevice(&m_file);
+    m_stream.setVersion(QDataStream::Qt_5_12);
+
+    if (!m_file.size())
+        m_stream << static_cast <quint32> (CAPTURE_MAGIC) << static_cast <quint16> (CAPTURE_VERSION);
+
+    return true;
+}
+
+void Capture::rotate(void)
+{
+    QString fileName = m_file.fileName(), backup = QString("%1.1").arg(fileName);
+
+    m_stream.setDevice(nullptr);
+    m_file.close();
+
+    QFile::remove(backup);
+
+    if (!QFile::rename(fileName, backup))
+        logWarning << "Capture file" << fileName << "rotation failed";
+
+    open();
+}
+
+Replay::Replay(const QString &fileName, double speed, std::function <bool (const QString &topic)> skip, QObject *parent) : QObject(parent), m_timer(new QTimer(this)), m_speed(speed), m_index(0), m_handled(0), m_outputs(0), m_matched(0), m_unexpected(0), m_lag(0), m_time(0), m_maxTime(0), m_duration(0)
+{
+    QFile file(fileName);
+    QDataStream stream;
+    quint32 magic;
+    quint16 version;
+    int skipped = 0;
+
+    connect(m_timer, &QTimer::timeout, this, &Replay::update);
+    m_timer->setSingleShot(true);
+
+    if (!file.open(QFile::ReadOnly))
+    {
+        logWarning << "Replay file" << fileName << "open failed";
+        return;
+    }
+
+    stream.setDevice(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream >> magic >> version;
+
+    if (magic != CAPTURE_MAGIC || version != CAPTURE_VERSION)
+    {
+        logWarning << "Replay file" << fileName << "format unsupported";
+        return;
+    }
+
+    while (!stream.atEnd())
+    {
+        captureStruct item;
+
+        stream >> item.type >> item.timestamp >> item.topic >> item.message;
+
+        if (stream.status() != QDataStream::Ok)
+            break;
+
+        if (item.type == static_cast <quint8> (Capture::Type::outbound))
+        {
+            m_expected[QByteArray(item.topic).append('\0').append(item.message)]++;
+            continue;
+        }
+
+        if (skip && skip(QString::fromUtf8(item.topic)))
+        {
+            skipped++;
+            continue;
+        }
+
+        m_messages.append(item);
+    }
+
+    file.close();
+    logInfo << "Replay loaded" << m_messages.count() << "messages from" << fileName << "with" << skipped << "service messages skipped";
+}
+
+void Replay::start(void)
+{
+    if (m_messages.isEmpty() || m_clock.isValid())
+        return;
+
+    logInfo << "Replay started with speed" << m_speed;
+    m_clock.start();
+    update();
+}
+
+void Replay::handled(qint64 time)
+{
+    if (!m_clock.isValid())
+        return;
+
+    m_time += time;
+    m_handled++;
+
+    if (m_maxTime < time)
+        m_maxTime = time;
+}
+
+void Replay::published(const QString &topic, const QByteArray &message)
+{
+    QByteArray key = topic.toUtf8().append('\0').append(message);
+
+    if (!m_clock.isValid())
+        return;
+
+    m_outputs++;
+
+    if (!m_expected.value(key))
+    {
+        m_unexpected++;
+        return;
+    }
+
+    m_expected[key]--;
+    m_matched++;
+}
+
+qint64 Replay::due(int index)
+{
+    return m_speed > 0 ? static_cast <qint64> ((m_messages.at(index).timestamp - m_messages.at(0).timestamp) / m_speed) : 0;
+}
+
+void Replay::update(void)
+{
+    int count = 0;
+
+    while (m_index < m_messages.count() && due(m_index) <= m_clock.elapsed() && count < REPLAY_BATCH)
+    {
+        const captureStruct &item = m_messages.at(m_index);
+        qint64 lag = m_clock.elapsed() - due(m_index);
+
+        if (m_lag < lag)
+            m_lag = lag;
+
+        emit message(item.message, QMqttTopicName(QString::fromUtf8(item.topic)));
+        m_index++;
+        count++;
+    }
+
+    if (m_index < m_messages.count())
+    {
+        m_timer->start(static_cast <int> (qMax(due(m_index) - m_clock.elapsed(), static_cast <qint64> (0))));
+        return;
+    }
+
+    m_duration = m_clock.elapsed();
+    QTimer::singleShot(REPLAY_SETTLE_DELAY, this, &Replay::report);
+}
+
+void Replay::report(void)
+{
+    int missing = 0;
+
+    for (auto it = m_expected.begin(); it != m_expected.end(); it++)
+        missing += it.value();
+
+    logInfo << "Replay finished:" << m_messages.count() << "messages in" << m_duration << "ms," << (m_duration ? static_cast <qint64> (m_messages.count()) * 1000 / m_duration : m_messages.count()) << "messages per second";
+    logInfo << "Replay dispatch latency: average" << (m_handled ? m_time / m_handled : 0) << "us, maximum" << m_maxTime << "us, maximum lag" << m_lag << "ms";
+    logInfo << "Replay outputs:" << m_outputs << "published," << m_matched << "matched," << missing << "missing," << m_unexpected << "unexpected";
+}
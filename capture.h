@@ -0,0 +1,91 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#define CAPTURE_MAGIC               0x48435243
+#define CAPTURE_VERSION             1
+#define CAPTURE_SIZE                104857600
+
+#define REPLAY_BATCH                100
+#define REPLAY_SETTLE_DELAY         1000
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMqttTopicName>
+#include <QTimer>
+#include <functional>
+
+struct captureStruct
+{
+    quint8 type;
+    qint64 timestamp;
+    QByteArray topic;
+    QByteArray message;
+};
+
+class Capture : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    enum class Type
+    {
+        inbound,
+        outbound
+    };
+
+    Capture(const QString &fileName, qint64 size, QObject *parent);
+    ~Capture(void);
+
+    void record(Type type, const QString &topic, const QByteArray &message);
+
+private:
+
+    QFile m_file;
+    QDataStream m_stream;
+    qint64 m_size;
+
+    bool open(void);
+    void rotate(void);
+
+};
+
+class Replay : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    Replay(const QString &fileName, double speed, std::function <bool (const QString &topic)> skip, QObject *parent);
+
+    void start(void);
+    void handled(qint64 time);
+    void published(const QString &topic, const QByteArray &message);
+
+private:
+
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+
+    QList <captureStruct> m_messages;
+    QMap <QByteArray, int> m_expected;
+
+    double m_speed;
+    int m_index, m_handled, m_outputs, m_matched, m_unexpected;
+    qint64 m_lag, m_time, m_maxTime, m_duration;
+
+    qint64 due(int index);
+
+private slots:
+
+    void update(void);
+    void report(void);
+
+signals:
+
+    void message(const QByteArray &message, const QMqttTopicName &topic);
+
+};
+
+#endif
@@ -1,26 +1,89 @@
+#include <QCborArray>
+#include <QCborMap>
+#include <QHostAddress>
 #include <QMimeDatabase>
 #include "controller.h"
 #include "logger.h"
 #include "parser.h"
 
-Controller::Controller(const QString &configFile) : HOMEd(SERVICE_VERSION, configFile, true), m_timer(new QTimer(this)), m_devices(new DeviceList(getConfig(), this)), m_commands(QMetaEnum::fromType <Command> ()), m_events(QMetaEnum::fromType <Event> ())
+Controller::Controller(const QString &configFile) : HOMEd(SERVICE_VERSION, configFile, true), m_timer(new QTimer(this)), m_republishTimer(new QTimer(this)), m_shardingTimer(new QTimer(this)), m_devices(new DeviceList(getConfig(), this)), m_inbound(new InboundQueue(getConfig()->value("inbound/size", INBOUND_SIZE).toInt(), getConfig()->value("inbound/batch", INBOUND_BATCH).toInt(), getConfig()->value("inbound/coalesce", INBOUND_COALESCE).toInt(), this)), m_outbound(new OutboundQueue(getConfig()->value("outbound/delay", OUTBOUND_DELAY).toInt(), getConfig()->value("outbound/interval", OUTBOUND_INTERVAL).toInt(), this)), m_poller(new Poller(getConfig()->value("poll/limit", POLL_LIMIT).toInt(), this)), m_capture(nullptr), m_replay(nullptr), m_sharding(nullptr), m_commands(QMetaEnum::fromType <Command> ()), m_events(QMetaEnum::fromType <Event> ())
 {
     m_haPrefix = getConfig()->value("homeassistant/prefix", "homeassistant").toString();
     m_haStatus = getConfig()->value("homeassistant/status", "homeassistant/status").toString();
     m_haEnabled = getConfig()->value("homeassistant/enabled", false).toBool();
     m_haUpdate = getConfig()->value("homeassistant/update", false).toBool();
 
+    m_republishIndex = 0;
+    m_republishSlice = getConfig()->value("republish/slice", REPUBLISH_SLICE).toInt();
+
     connect(m_timer, &QTimer::timeout, this, &Controller::updateProperties);
+    connect(m_republishTimer, &QTimer::timeout, this, &Controller::republishProperties);
     connect(m_devices, &DeviceList::devicetUpdated, this, &Controller::devicetUpdated);
+    connect(m_devices, &DeviceList::statusUpdated, this, &Controller::statusUpdated);
     connect(m_devices, &DeviceList::addSubscription, this, &Controller::addSubscription);
+    connect(m_inbound, &InboundQueue::message, this, &Controller::handleMessage);
+    connect(m_outbound, &OutboundQueue::publish, this, &Controller::publishOutbound);
+    connect(m_poller, &Poller::poll, this, &Controller::pollDevice);
+    connect(m_poller, &Poller::statusChanged, this, &Controller::pollStatus);
+
+    if (!getConfig()->value("capture/file").toString().isEmpty())
+        m_capture = new Capture(getConfig()->value("capture/file").toString(), getConfig()->value("capture/size", CAPTURE_SIZE).toLongLong(), this);
+
+    if (!getConfig()->value("replay/file").toString().isEmpty())
+    {
+        QString host = getConfig()->value("mqtt/host", "localhost").toString();
+
+        if (host == "localhost" || QHostAddress(host).isLoopback())
+        {
+            m_replay = new Replay(getConfig()->value("replay/file").toString(), getConfig()->value("replay/speed", 1).toDouble(), [this] (const QString &topic) { QString subTopic = QString(topic).replace(0, mqttTopic().length(), QString()); return subTopic == QString("command/%1").arg(serviceTopic()) || subTopic.startsWith("service/"); }, this);
+            connect(m_replay, &Replay::message, this, &Controller::mqttReceived);
+            connect(m_inbound, &InboundQueue::dispatched, m_replay, &Replay::handled);
+        }
+        else
+            logWarning << "Replay disabled, MQTT host" << host << "is not a loopback address";
+    }
+
+    if (!getConfig()->value("sharding/instances").toStringList().isEmpty())
+    {
+        QList <QString> instances = getConfig()->value("sharding/instances").toStringList();
+        QString instance = getConfig()->value("mqtt/instance").toString();
+
+        if (instances.contains(instance))
+        {
+            m_sharding = new Sharding(instance, instances, this);
+            m_devices->setFilter([this] (DeviceObject *device) { return owned(device); });
+            logInfo << "Sharding enabled for instance" << instance << "with" << instances.count() << "instances";
+        }
+        else
+            logWarning << "Sharding disabled, instance" << instance << "is not listed";
+    }
+
+    connect(m_shardingTimer, &QTimer::timeout, this, &Controller::updateSharding);
 
     m_timer->setSingleShot(true);
+    m_shardingTimer->setSingleShot(true);
+    m_republishTimer->setInterval(getConfig()->value("republish/interval", REPUBLISH_INTERVAL).toInt());
+
     m_devices->init();
+    recomputeProperties();
+
+    for (int i = 0; i < m_devices->count(); i++)
+        if (owned(m_devices->at(i).data()))
+            m_poller->update(m_devices->at(i).data());
+}
+
+bool Controller::owned(DeviceObject *device)
+{
+    return !m_sharding || m_owned.contains(device->id());
 }
 
 void Controller::publishExposes(DeviceObject *device, bool remove)
 {
-    device->publishExposes(this, device->id(), QString("%1_%2").arg(uniqueId(), device->id().remove(':')), m_haPrefix, m_haEnabled, m_haUpdate, m_devices->names(), remove);
+    if (!remove && !owned(device))
+        return;
+
+    if (!device->lazy())
+        device->publishExposes(this, device->id(), QString("%1_%2").arg(uniqueId(), device->id().remove(':')), m_haPrefix, m_haEnabled, m_haUpdate, m_devices->names(), remove);
 
     if (remove)
         return;
@@ -32,11 +95,15 @@ void Controller::publishExposes(DeviceObject *device, bool remove)
 void Controller::publishProperties(DeviceObject *device)
 {
     const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+    QString topic = mqttTopic("fd/%1/%2").arg(serviceTopic(), m_devices->names() ? device->name() : device->id());
+    QJsonObject json;
 
     if (endpoint->properties().isEmpty())
         return;
 
-    mqttPublish(mqttTopic("fd/%1/%2").arg(serviceTopic(), m_devices->names() ? device->name() : device->id()), QJsonObject::fromVariantMap(endpoint->properties()), device->options().value("retain").toBool());
+    json = QJsonObject::fromVariantMap(endpoint->properties());
+    mqttPublish(topic, json, device->options().value("retain").toBool());
+    recordOutput(topic, json);
 }
 
 void Controller::publishEvent(const QString &name, Event event)
@@ -53,12 +120,20 @@ void Controller::deviceEvent(DeviceObject *device, Event event)
         case Event::aboutToRename:
         case Event::removed:
             mqttPublish(mqttTopic("device/%1/%2").arg(serviceTopic(), m_devices->names() ? device->name() : device->id()), QJsonObject(), true);
+            m_poller->remove(device);
             remove = true;
             break;
 
         case Event::added:
         case Event::updated:
+        {
+            if (owned(device))
+                m_poller->update(device);
+            else if (m_sharding && mqttStatus() && !m_shardingTimer->isActive())
+                m_shardingTimer->start(SHARDING_DELAY);
+
             break;
+        }
 
         default:
             check = false;
@@ -71,6 +146,121 @@ void Controller::deviceEvent(DeviceObject *device, Event event)
     publishEvent(device->name(), event);
 }
 
+void Controller::forwardCommand(const QJsonObject &json)
+{
+    QJsonObject data = json;
+
+    if (!m_sharding || json.value("forwarded").toBool())
+        return;
+
+    data.insert("forwarded", true);
+
+    for (int i = 0; i < m_sharding->instances().count(); i++)
+        if (m_sharding->instances().at(i) != m_sharding->instance())
+            mqttPublish(mqttTopic("command/%1/%2").arg(serviceTopic().section('/', 0, 0), m_sharding->instances().at(i)), data);
+}
+
+void Controller::recordOutput(const QString &topic, const QByteArray &message)
+{
+    if (m_capture)
+        m_capture->record(Capture::Type::outbound, topic, message);
+
+    if (m_replay)
+        m_replay->published(topic, message);
+}
+
+void Controller::recordOutput(const QString &topic, const QJsonObject &json)
+{
+    if (!m_capture && !m_replay)
+        return;
+
+    recordOutput(topic, QJsonDocument(json).toJson(QJsonDocument::Compact));
+}
+
+QVariant Controller::binaryValue(const QByteArray &data, const QString &path)
+{
+    QRegExp bit("^bit\\[(\\d+)\\]$"), number("^([suf])(8|16|32|64)(le|be)?\\[(\\d+)\\]$");
+    const uchar *buffer = reinterpret_cast <const uchar*> (data.constData());
+    quint64 value = 0;
+    qint64 offset;
+    int size;
+    char type;
+    bool check;
+
+    if (bit.exactMatch(path))
+    {
+        offset = bit.cap(1).toLongLong(&check);
+
+        if (!check || offset / 8 >= data.length())
+            return QVariant();
+
+        return (buffer[offset / 8] >> offset % 8) & 1;
+    }
+
+    if (!number.exactMatch(path))
+        return QVariant();
+
+    type = number.cap(1).at(0).toLatin1();
+    size = number.cap(2).toInt();
+    offset = number.cap(4).toLongLong(&check);
+
+    if (!check || (type == 'f' && size < 32) || offset > data.length() - size / 8)
+        return QVariant();
+
+    for (int i = 0; i < size / 8; i++)
+        value |= static_cast <quint64> (buffer[offset + i]) << 8 * (number.cap(3) == "le" ? i : size / 8 - i - 1);
+
+    switch (type)
+    {
+        case 's':
+            return static_cast <qint64> (value << (64 - size)) >> (64 - size);
+
+        case 'f':
+        {
+            quint32 raw = static_cast <quint32> (value);
+            float single;
+            double result;
+
+            if (size == 32)
+            {
+                memcpy(&single, &raw, sizeof(single));
+                return single;
+            }
+
+            memcpy(&result, &value, sizeof(result));
+            return result;
+        }
+
+        default:
+            return value;
+    }
+}
+
+QVariant Controller::cborValue(const QByteArray &data, const QString &path)
+{
+    QCborValue value = QCborValue::fromCbor(data);
+    QList <QString> list = path.split('.');
+
+    for (int i = 0; i < list.count(); i++)
+    {
+        if (value.isArray())
+        {
+            bool check;
+            int index = list.at(i).toUInt(&check);
+
+            if (!check)
+                return QVariant();
+
+            value = value.toArray().at(index);
+            continue;
+        }
+
+        value = value.toMap().value(list.at(i));
+    }
+
+    return value.isUndefined() ? QVariant() : value.toVariant();
+}
+
 QVariant Controller::parsePattern(QString string, const QVariant &data)
 {
     QRegExp replace("\\{\\{[^\\{\\}]*\\}\\}"), split("\\s+(?=(?:[^']*['][^']*['])*[^']*$)");
@@ -104,10 +294,20 @@ QVariant Controller::parsePattern(QString string, const QVariant &data)
                 value = Parser::urlValue(data.toString().toUtf8(), item.mid(item.indexOf('.') + 1));
             else if (item.startsWith("xml."))
                 value = Parser::xmlValue(data.toString().toUtf8(), item.mid(item.indexOf('.') + 1));
+            else if (item.startsWith("bin."))
+                value = binaryValue(data.toByteArray(), item.mid(item.indexOf('.') + 1));
+            else if (item.startsWith("hex."))
+                value = binaryValue(QByteArray::fromHex(data.toByteArray()), item.mid(item.indexOf('.') + 1));
+            else if (item.startsWith("cbor."))
+                value = cborValue(data.toByteArray(), item.mid(item.indexOf('.') + 1));
+            else if (item.startsWith("property."))
+                value = data.toMap().value(item.mid(item.indexOf('.') + 1));
             else if (QRegExp("^value\\[\\d\\]$").exactMatch(item))
                 value = data.toList().value(item.mid(6, item.length() - 7).toInt());
             else if (item == "value")
                 value = data;
+            else if (item == "hex")
+                value = data.toByteArray().toHex();
             else
                 value = item;
 
@@ -145,11 +345,233 @@ QVariant Controller::parsePattern(QString string, const QVariant &data)
     return string != "_NULL_" ? Parser::stringValue(string) : QVariant();
 }
 
+bool Controller::computeProperty(DeviceObject *device, const QString &key)
+{
+    const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+    const Computed &computed = endpoint->computed().value(key);
+    QMap <QString, QVariant> data;
+    QVariant value;
+
+    if (computed.isNull())
+        return false;
+
+    for (auto it = computed->references().begin(); it != computed->references().end(); it++)
+    {
+        Device source = it.value().device.toStrongRef();
+        data.insert(it.key(), source.isNull() ? QVariant() : source->endpoints().value(DEFAULT_ENDPOINT)->properties().value(it.value().property));
+    }
+
+    value = parsePattern(computed->pattern(), data);
+
+    if (!value.isValid() || endpoint->properties().value(key) == value)
+        return false;
+
+    endpoint->properties().insert(key, value);
+    device->timer()->start(UPDATE_DEVICE_DELAY);
+    m_devices->storeProperties();
+    updateHistory(device, {key});
+    return true;
+}
+
+void Controller::updateComputed(DeviceObject *device, const QList <QString> &keys)
+{
+    QMap <QString, referenceStruct> nodes;
+    QMap <QString, int> degree;
+    QList <QString> queue;
+    QSet <QString> expanded, changed;
+
+    for (int i = 0; i < keys.count(); i++)
+    {
+        QString node = QString("%1/%2").arg(device->id(), keys.at(i));
+        queue.append(node);
+        changed.insert(node);
+    }
+
+    while (!queue.isEmpty())
+    {
+        QString source = queue.takeFirst();
+        QList <referenceStruct> list = m_devices->dependencies().value(source);
+
+        if (expanded.contains(source))
+            continue;
+
+        expanded.insert(source);
+
+        for (int i = 0; i < list.count(); i++)
+        {
+            Device item = list.at(i).device.toStrongRef();
+            QString node;
+
+            if (item.isNull() || !item->active())
+                continue;
+
+            if (!owned(item.data()))
+                continue;
+
+            node = QString("%1/%2").arg(item->id(), list.at(i).property);
+            nodes.insert(node, list.at(i));
+            degree[node]++;
+            queue.append(node);
+        }
+    }
+
+    for (auto it = changed.begin(); it != changed.end(); it++)
+        if (!degree.value(*it))
+            queue.append(*it);
+
+    while (!queue.isEmpty())
+    {
+        QString node = queue.takeFirst();
+        QList <referenceStruct> list = m_devices->dependencies().value(node);
+
+        if (nodes.contains(node) && !changed.contains(node))
+        {
+            Device item = nodes.value(node).device.toStrongRef();
+            QString key = nodes.value(node).property;
+            const Computed &computed = item->endpoints().value(DEFAULT_ENDPOINT)->computed().value(key);
+            bool check = false;
+
+            if (!computed.isNull())
+            {
+                for (auto it = computed->references().begin(); it != computed->references().end(); it++)
+                {
+                    Device source = it.value().device.toStrongRef();
+
+                    if (source.isNull() || !changed.contains(QString("%1/%2").arg(source->id(), it.value().property)))
+                        continue;
+
+                    check = true;
+                    break;
+                }
+            }
+
+            if (check && computeProperty(item.data(), key))
+                changed.insert(node);
+        }
+
+        for (int i = 0; i < list.count(); i++)
+        {
+            Device item = list.at(i).device.toStrongRef();
+            QString dependent;
+
+            if (item.isNull() || !item->active())
+                continue;
+
+            if (!owned(item.data()))
+                continue;
+
+            dependent = QString("%1/%2").arg(item->id(), list.at(i).property);
+
+            if (--degree[dependent])
+                continue;
+
+            queue.append(dependent);
+        }
+    }
+}
+
+void Controller::recomputeProperties(void)
+{
+    QMap <QString, referenceStruct> nodes;
+    QMap <QString, int> degree;
+    QList <QString> queue;
+
+    for (int i = 0; i < m_devices->count(); i++)
+    {
+        const Device &device = m_devices->at(i);
+        const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+
+        if (!device->active() || !owned(device.data()))
+            continue;
+
+        for (auto it = endpoint->computed().begin(); it != endpoint->computed().end(); it++)
+        {
+            QString node = QString("%1/%2").arg(device->id(), it.key());
+
+            if (m_devices->circular().contains(node))
+                continue;
+
+            nodes.insert(node, {device, it.key()});
+        }
+    }
+
+    for (auto it = nodes.begin(); it != nodes.end(); it++)
+    {
+        QList <referenceStruct> list = m_devices->dependencies().value(it.key());
+
+        for (int i = 0; i < list.count(); i++)
+        {
+            Device item = list.at(i).device.toStrongRef();
+            QString node;
+
+            if (item.isNull())
+                continue;
+
+            node = QString("%1/%2").arg(item->id(), list.at(i).property);
+
+            if (nodes.contains(node))
+                degree[node]++;
+        }
+    }
+
+    for (auto it = nodes.begin(); it != nodes.end(); it++)
+        if (!degree.value(it.key()))
+            queue.append(it.key());
+
+    while (!queue.isEmpty())
+    {
+        QString node = queue.takeFirst();
+        QList <referenceStruct> list = m_devices->dependencies().value(node);
+
+        computeProperty(nodes.value(node).device.toStrongRef().data(), nodes.value(node).property);
+
+        for (int i = 0; i < list.count(); i++)
+        {
+            Device item = list.at(i).device.toStrongRef();
+            QString dependent;
+
+            if (item.isNull())
+                continue;
+
+            dependent = QString("%1/%2").arg(item->id(), list.at(i).property);
+
+            if (!nodes.contains(dependent) || --degree[dependent])
+                continue;
+
+            queue.append(dependent);
+        }
+    }
+}
+
+void Controller::updateHistory(DeviceObject *device, const QList <QString> &keys)
+{
+    const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+
+    if (endpoint->history().isEmpty())
+        return;
+
+    for (int i = 0; i < keys.count(); i++)
+    {
+        const History &history = endpoint->history().value(keys.at(i));
+
+        if (history.isNull() || !endpoint->properties().contains(keys.at(i)))
+            continue;
+
+        history->append(endpoint->properties().value(keys.at(i)));
+    }
+}
+
 void Controller::quit(void)
 {
+    m_republishTimer->stop();
+
     for (int i = 0; i < m_devices->count(); i++)
     {
         const Device &device = m_devices->at(i);
+
+        if (!owned(device.data()))
+            continue;
+
         mqttPublish(mqttTopic("device/%1/%2").arg(serviceTopic(), m_devices->names() ? device->name() : device->id()), {{"status", "offline"}}, true);
     }
 
@@ -163,6 +585,15 @@ void Controller::mqttConnected(void)
     mqttSubscribe(mqttTopic("fd/%1/#").arg(serviceTopic()));
     mqttSubscribe(mqttTopic("td/%1/#").arg(serviceTopic()));
 
+    if (m_sharding)
+    {
+        for (int i = 0; i < m_sharding->instances().count(); i++)
+            if (m_sharding->instances().at(i) != m_sharding->instance())
+                mqttSubscribe(mqttTopic("service/%1/%2").arg(serviceTopic().section('/', 0, 0), m_sharding->instances().at(i)));
+
+        m_shardingTimer->start(SHARDING_DELAY);
+    }
+
     for (int i = 0; i < m_devices->count(); i++)
         publishExposes(m_devices->at(i).data());
 
@@ -180,9 +611,30 @@ void Controller::mqttConnected(void)
 
     m_devices->storeDatabase();
     mqttPublishService();
+
+    if (m_replay)
+        m_replay->start();
 }
 
 void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &topic)
+{
+    QString subTopic = topic.name().replace(0, mqttTopic().length(), QString());
+    InboundQueue::Priority priority = InboundQueue::Priority::availability;
+
+    if (m_capture)
+        m_capture->record(Capture::Type::inbound, topic.name(), message);
+
+    if (subTopic == QString("command/%1").arg(serviceTopic()) || subTopic.startsWith("service/"))
+        priority = InboundQueue::Priority::service;
+    else if (subTopic.startsWith(QString("td/%1/").arg(serviceTopic())))
+        priority = InboundQueue::Priority::control;
+    else if (m_subscriptions.contains(topic.name()) && !m_availability.contains(topic.name()))
+        priority = InboundQueue::Priority::telemetry;
+
+    m_inbound->enqueue(priority, message, topic);
+}
+
+void Controller::handleMessage(const QByteArray &message, const QMqttTopicName &topic)
 {
     QString subTopic = topic.name().replace(0, mqttTopic().length(), QString());
     QJsonObject json = QJsonDocument::fromJson(message).object();
@@ -193,8 +645,11 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
         {
             const Device &device = m_devices->at(i);
             const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+            QList <QString> keys;
+            QString statusTopic;
+            QJsonObject status;
 
-            if (!device->active() || !device->real())
+            if (!device->active() || !device->real() || !owned(device.data()))
                 continue;
 
             for (auto it = endpoint->bindings().begin(); it != endpoint->bindings().end(); it++)
@@ -204,6 +659,7 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
                 if (it.value()->inTopic() != topic.name())
                     continue;
 
+                m_poller->received(device.data(), it.key());
                 value = parsePattern(it.value()->inPattern(), message);
 
                 if (it.key().split('_').value(0) == "color")
@@ -223,12 +679,23 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
                 endpoint->properties().insert(it.key(), value);
                 device->timer()->start(UPDATE_DEVICE_DELAY);
                 m_devices->storeProperties();
+                keys.append(it.key());
+            }
+
+            if (!keys.isEmpty())
+            {
+                updateHistory(device.data(), keys);
+                updateComputed(device.data(), keys);
             }
 
             if (device->availabilityTopic() != topic.name())
                 continue;
 
-            mqttPublish(mqttTopic("device/%1/%2").arg(serviceTopic(), m_devices->names() ? device->name() : device->id()), {{"status", parsePattern(device->availabilityPattern(), message).toString() == "online" ? "online" : "offline"}}, true);
+            statusTopic = mqttTopic("device/%1/%2").arg(serviceTopic(), m_devices->names() ? device->name() : device->id());
+            status = {{"status", parsePattern(device->availabilityPattern(), message).toString() == "online" ? "online" : "offline"}};
+
+            mqttPublish(statusTopic, status, true);
+            recordOutput(statusTopic, status);
         }
     }
 
@@ -250,7 +717,6 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
                 QJsonObject data = json.value("data").toObject();
                 QString id = mqttSafe(data.value("id").toString()), name = mqttSafe(data.value("name").toString()), service;
                 Device device = m_devices->byName(json.value("device").toString(), &index), other = m_devices->byName(id);
-                QMap <QString, QVariant> properies;
 
                 if (device != other && !other.isNull())
                 {
@@ -274,7 +740,6 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
                         deviceEvent(device.data(), Event::aboutToRename);
 
                     service = device->service();
-                    properies = device->endpoints().value(DEFAULT_ENDPOINT)->properties();
                 }
 
                 device = m_devices->parse(data, service);
@@ -288,7 +753,10 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
 
                 if (index >= 0)
                 {
-                    device->endpoints().value(DEFAULT_ENDPOINT)->properties() = properies;
+                    if (device->lazy() && !m_devices->at(index)->lazy())
+                        publishExposes(m_devices->at(index).data(), true);
+
+                    m_devices->copyState(m_devices->at(index), device);
                     m_devices->replace(index, device);
                     logInfo << device << "successfully updated";
                     deviceEvent(device.data(), Event::updated);
@@ -300,8 +768,11 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
                     deviceEvent(device.data(), Event::added);
                 }
 
+                m_devices->updateDependencies();
+                recomputeProperties();
                 m_devices->storeDatabase(true);
                 m_devices->storeProperties();
+                forwardCommand(json);
                 break;
             }
 
@@ -315,8 +786,11 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
                     m_devices->removeAt(index);
                     logInfo << device << "removed";
                     deviceEvent(device.data(), Event::removed);
+                    m_devices->updateDependencies();
+                    recomputeProperties();
                     m_devices->storeDatabase(true);
                     m_devices->storeProperties();
+                    forwardCommand(json);
                 }
 
                 break;
@@ -326,11 +800,152 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
             {
                 Device device = m_devices->byName(json.value("device").toString());
 
-                if (!device.isNull() && device->active())
+                if (!device.isNull() && device->active() && owned(device.data()))
                     publishProperties(device.data());
 
                 break;
             }
+
+            case Command::updateProfile:
+            {
+                QString name = json.value("profile").toString();
+                QList <QJsonObject> data;
+                QList <int> list;
+
+                for (int i = 0; i < m_devices->count(); i++)
+                {
+                    const Device &device = m_devices->at(i);
+
+                    if (device->profile().isNull() || device->profile()->name() != name)
+                        continue;
+
+                    data.append(m_devices->serializeDevice(device));
+                    list.append(i);
+                }
+
+                if (!m_devices->updateProfile(name, json.value("data").toObject()))
+                {
+                    logWarning << "Profile" << name << "update failed, data is incomplete";
+                    break;
+                }
+
+                logInfo << "Profile" << name << "successfully updated";
+                forwardCommand(json);
+
+                for (int i = 0; i < list.count(); i++)
+                {
+                    Device device = m_devices->at(list.at(i)), other = m_devices->parse(data.at(i), device->service());
+
+                    if (other.isNull())
+                    {
+                        logWarning << device << "update failed, data is incomplete";
+                        continue;
+                    }
+
+                    m_devices->copyState(device, other);
+                    m_devices->replace(list.at(i), other);
+                    logInfo << other << "successfully updated";
+                    deviceEvent(other.data(), Event::updated);
+                }
+
+                m_devices->updateDependencies();
+                recomputeProperties();
+                m_devices->storeDatabase(true);
+                m_devices->storeProperties();
+                break;
+            }
+
+            case Command::removeProfile:
+            {
+                QString name = json.value("profile").toString();
+
+                if (!m_devices->removeProfile(name))
+                {
+                    logWarning << "Profile" << name << "remove failed, profile not found or in use";
+                    break;
+                }
+
+                logInfo << "Profile" << name << "removed";
+                m_devices->storeDatabase(true);
+                forwardCommand(json);
+                break;
+            }
+
+            case Command::getHistory:
+            {
+                Device device = m_devices->byName(json.value("device").toString());
+                QString property = json.value("property").toString();
+                History history;
+                QJsonObject data;
+
+                if (device.isNull() || !device->active() || !owned(device.data()))
+                    break;
+
+                history = device->endpoints().value(DEFAULT_ENDPOINT)->history().value(property);
+
+                if (history.isNull())
+                    break;
+
+                data = history->query(static_cast <quint32> (json.value("start").toDouble()), static_cast <quint32> (json.value("end").toDouble(QDateTime::currentSecsSinceEpoch())), static_cast <quint32> (json.value("interval").toDouble()));
+                data.insert("property", property);
+
+                mqttPublish(mqttTopic("history/%1/%2").arg(serviceTopic(), m_devices->names() ? device->name() : device->id()), data);
+                break;
+            }
+
+            case Command::reloadService:
+            {
+                QList <QPair <Device, Device>> list;
+                QElapsedTimer timer;
+
+                logInfo << "Reload request received...";
+                timer.start();
+
+                if (!m_devices->reload(list))
+                {
+                    logWarning << "Reload failed, no changes applied";
+                    break;
+                }
+
+                for (int i = 0; i < list.count(); i++)
+                {
+                    const Device &device = list.at(i).first, &other = list.at(i).second;
+
+                    if (device.isNull())
+                    {
+                        logInfo << other << "successfully added";
+                        deviceEvent(other.data(), Event::added);
+                        continue;
+                    }
+
+                    if (other.isNull())
+                    {
+                        logInfo << device << "removed";
+                        deviceEvent(device.data(), Event::removed);
+                        continue;
+                    }
+
+                    if (device->name() != other->name())
+                        deviceEvent(device.data(), Event::aboutToRename);
+                    else if (other->lazy() && !device->lazy())
+                        publishExposes(device.data(), true);
+
+                    logInfo << other << "successfully updated";
+                    deviceEvent(other.data(), Event::updated);
+                }
+
+                logInfo << "Reload finished," << list.count() << "devices changed in" << timer.elapsed() << "ms";
+                forwardCommand(json);
+
+                if (list.isEmpty())
+                    break;
+
+                m_devices->updateDependencies();
+                recomputeProperties();
+                m_devices->storeDatabase(true);
+                m_devices->storeProperties();
+                break;
+            }
         }
     }
     else if (subTopic.startsWith(QString("fd/%1/").arg(serviceTopic())))
@@ -339,7 +954,7 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
         Device device = m_devices->byName(list.value(0));
         Endpoint endpoint;
 
-        if (device.isNull() || !device->active() || !device->real())
+        if (device.isNull() || !device->active() || !device->real() || !owned(device.data()))
             return;
 
         endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
@@ -358,6 +973,8 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
             endpoint->properties().insert(it.key(), it.value().toVariant());
         }
 
+        updateHistory(device.data(), json.keys());
+        updateComputed(device.data(), json.keys());
         m_devices->storeProperties();
     }
     else if (subTopic.startsWith(QString("td/%1/").arg(serviceTopic())))
@@ -366,7 +983,7 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
         Device device = m_devices->byName(list.value(0));
         Endpoint endpoint;
 
-        if (device.isNull() || !device->active())
+        if (device.isNull() || !device->active() || !owned(device.data()))
             return;
 
         endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
@@ -383,7 +1000,7 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
                 const Binding &binding = endpoint->bindings().value(it.key());
 
                 if (!binding.isNull() && !binding->outTopic().isEmpty())
-                    mqttPublishString(binding->outTopic(), parsePattern(binding->outPattern(), value).toString(), binding->retain());
+                    m_outbound->enqueue(QString("%1/%2").arg(device->id(), it.key()), binding, value);
 
                 continue;
             }
@@ -401,8 +1018,21 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
             return;
 
         device->timer()->start(UPDATE_DEVICE_DELAY);
+        updateHistory(device.data(), json.keys());
+        updateComputed(device.data(), json.keys());
         m_devices->storeProperties();
     }
+    else if (m_sharding && subTopic.startsWith("service/"))
+    {
+        QString instance = subTopic.section('/', 2);
+        bool online = json.value("status").toString() == "online";
+
+        if (!m_sharding->setStatus(instance, online))
+            return;
+
+        logInfo << "Sharding instance" << instance << "is" << (online ? "online" : "offline");
+        m_shardingTimer->start(SHARDING_DELAY);
+    }
     else if (topic.name() == m_haStatus)
     {
         if (message != "online")
@@ -414,24 +1044,230 @@ void Controller::mqttReceived(const QByteArray &message, const QMqttTopicName &t
 
 void Controller::updateProperties(void)
 {
+    m_republishIndex = 0;
+    m_republishTimer->start();
+    republishProperties();
+}
+
+void Controller::republishProperties(void)
+{
+    int count = 0;
+
+    while (m_republishIndex < m_devices->count() && count < m_republishSlice)
+    {
+        const Device &device = m_devices->at(m_republishIndex++);
+
+        if (!device->active() || !owned(device.data()))
+            continue;
+
+        publishProperties(device.data());
+        count++;
+    }
+
+    if (m_republishIndex < m_devices->count())
+        return;
+
+    m_republishTimer->stop();
+}
+
+void Controller::updateSharding(void)
+{
+    QSet <QString> owned, subscriptions;
+
     for (int i = 0; i < m_devices->count(); i++)
     {
         const Device &device = m_devices->at(i);
+        const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
 
-        if (!device->active())
+        if (!m_sharding->owns(device->id()))
             continue;
 
-        publishProperties(device.data());
+        owned.insert(device->id());
+
+        for (auto it = endpoint->bindings().begin(); it != endpoint->bindings().end(); it++)
+            if (!it.value()->inTopic().isEmpty())
+                subscriptions.insert(it.value()->inTopic());
+
+        if (!device->availabilityTopic().isEmpty())
+            subscriptions.insert(device->availabilityTopic());
+    }
+
+    for (int i = m_subscriptions.count() - 1; i >= 0; i--)
+    {
+        QString topic = m_subscriptions.at(i);
+
+        if (subscriptions.contains(topic))
+            continue;
+
+        logInfo << "MQTT unsubscribed from" << topic;
+        mqttUnsubscribe(topic);
+        m_subscriptions.removeAt(i);
+    }
+
+    for (auto it = subscriptions.begin(); it != subscriptions.end(); it++)
+    {
+        if (m_subscriptions.contains(*it))
+            continue;
+
+        logInfo << "MQTT subscribed to" << *it;
+        mqttSubscribe(*it);
+        m_subscriptions.append(*it);
+    }
+
+    for (int i = 0; i < m_devices->count(); i++)
+    {
+        DeviceObject *device = m_devices->at(i).data();
+
+        if (owned.contains(device->id()) == m_owned.contains(device->id()))
+            continue;
+
+        if (owned.contains(device->id()))
+        {
+            m_owned.insert(device->id());
+            publishExposes(device);
+            m_poller->update(device);
+            continue;
+        }
+
+        mqttPublish(mqttTopic("device/%1/%2").arg(serviceTopic(), m_devices->names() ? device->name() : device->id()), QJsonObject(), true);
+        publishExposes(device, true);
+        m_poller->remove(device);
+    }
+
+    m_owned = owned;
+    recomputeProperties();
+
+    for (int i = 0; i < m_devices->count(); i++)
+    {
+        const Device &device = m_devices->at(i);
+        const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+
+        if (!owned.contains(device->id()))
+            continue;
+
+        for (auto it = endpoint->computed().begin(); it != endpoint->computed().end(); it++)
+        {
+            for (auto reference = it.value()->references().begin(); reference != it.value()->references().end(); reference++)
+            {
+                Device source = reference.value().device.toStrongRef();
+
+                if (source.isNull() || owned.contains(source->id()))
+                    continue;
+
+                logWarning << device << "computed property" << it.key() << "references" << source << "owned by another instance, reference is not updated";
+            }
+        }
+    }
+
+    logInfo << "Sharding updated," << owned.count() << "of" << m_devices->count() << "devices owned";
+    m_devices->storeDatabase();
+}
+
+void Controller::publishOutbound(const QString &topic, const QList <outboundStruct> &list)
+{
+    QString message;
+    QJsonObject json;
+    bool retain;
+    int count = 1;
+
+    if (list.isEmpty())
+        return;
+
+    message = parsePattern(list.first().binding->outPattern(), list.first().value).toString();
+    json = QJsonDocument::fromJson(message.toUtf8()).object();
+    retain = list.first().binding->retain();
+
+    for (; count < list.count() && !json.isEmpty(); count++)
+    {
+        const outboundStruct &item = list.at(count);
+        QJsonObject data;
+        bool check = true;
+
+        if (item.binding->retain() != retain)
+            break;
+
+        data = QJsonDocument::fromJson(parsePattern(item.binding->outPattern(), item.value).toString().toUtf8()).object();
+
+        if (data.isEmpty())
+            break;
+
+        for (auto it = data.begin(); it != data.end(); it++)
+        {
+            if (!json.contains(it.key()) || json.value(it.key()) == it.value())
+                continue;
+
+            check = false;
+            break;
+        }
+
+        if (!check)
+            break;
+
+        for (auto it = data.begin(); it != data.end(); it++)
+            json.insert(it.key(), it.value());
     }
+
+    if (count > 1)
+        message = QString(QJsonDocument(json).toJson(QJsonDocument::Compact));
+
+    mqttPublishString(topic, message, retain);
+    recordOutput(topic, message.toUtf8());
+
+    if (count < list.count())
+        m_outbound->restore(topic, list.mid(count));
+}
+
+void Controller::pollDevice(const Binding &binding)
+{
+    QString message = parsePattern(binding->poll().pattern, QVariant()).toString();
+    mqttPublishString(binding->outTopic(), message, false);
+    recordOutput(binding->outTopic(), message.toUtf8());
+}
+
+void Controller::pollStatus(DeviceObject *device, bool online)
+{
+    QString topic = mqttTopic("device/%1/%2").arg(serviceTopic(), m_devices->names() ? device->name() : device->id());
+    QJsonObject json = {{"status", online ? "online" : "offline"}};
+
+    if (!online)
+        logWarning << "Device" << device->name() << "poll response timed out";
+
+    mqttPublish(topic, json, true);
+    recordOutput(topic, json);
+}
+
+void Controller::statusUpdated(const QByteArray &status)
+{
+    mqttPublishString(mqttTopic("status/%1").arg(serviceTopic()), QString(status), true);
 }
 
 void Controller::devicetUpdated(DeviceObject *device)
 {
+    if (!owned(device))
+        return;
+
     publishProperties(device);
 }
 
 void Controller::addSubscription(const QString &topic, bool resubscribe)
 {
+    if (resubscribe)
+        m_availability.insert(topic);
+
+    if (m_sharding)
+    {
+        if (resubscribe && m_subscriptions.contains(topic))
+        {
+            mqttUnsubscribe(topic);
+            mqttSubscribe(topic);
+        }
+
+        if (mqttStatus() && !m_shardingTimer->isActive())
+            m_shardingTimer->start(SHARDING_DELAY);
+
+        return;
+    }
+
     if (m_subscriptions.contains(topic))
     {
         if (!resubscribe)
@@ -7,9 +7,17 @@
 #define UPDATE_DEVICE_DELAY         100
 #define UPDATE_PROPERTIES_DELAY     1000
 
+#define REPUBLISH_SLICE             50
+#define REPUBLISH_INTERVAL          10
+
 #include <QMetaEnum>
+#include "capture.h"
 #include "device.h"
 #include "homed.h"
+#include "inbound.h"
+#include "outbound.h"
+#include "poller.h"
+#include "sharding.h"
 
 class Controller : public HOMEd
 {
@@ -22,7 +30,11 @@ public:
         restartService,
         updateDevice,
         removeDevice,
-        getProperties
+        getProperties,
+        updateProfile,
+        removeProfile,
+        getHistory,
+        reloadService
     };
 
     enum class Event
@@ -43,21 +55,43 @@ public:
 
 private:
 
-    QTimer *m_timer;
+    QTimer *m_timer, *m_republishTimer, *m_shardingTimer;
     DeviceList *m_devices;
+    InboundQueue *m_inbound;
+    OutboundQueue *m_outbound;
+    Poller *m_poller;
+
+    Capture *m_capture;
+    Replay *m_replay;
+    Sharding *m_sharding;
 
     QMetaEnum m_commands, m_events;
     QString m_haPrefix, m_haStatus;
     bool m_haEnabled, m_haUpdate;
 
+    int m_republishIndex, m_republishSlice;
+
     QList <QString> m_subscriptions;
+    QSet <QString> m_availability, m_owned;
+
+    bool owned(DeviceObject *device);
 
     void publishExposes(DeviceObject *device, bool remove = false);
     void publishProperties(DeviceObject *device);
     void publishEvent(const QString &name, Event event);
     void deviceEvent(DeviceObject *device, Event event);
+    void forwardCommand(const QJsonObject &json);
+
+    void recordOutput(const QString &topic, const QByteArray &message);
+    void recordOutput(const QString &topic, const QJsonObject &json);
 
+    QVariant binaryValue(const QByteArray &data, const QString &path);
+    QVariant cborValue(const QByteArray &data, const QString &path);
     QVariant parsePattern(QString string, const QVariant &data);
+    bool computeProperty(DeviceObject *device, const QString &key);
+    void updateComputed(DeviceObject *device, const QList <QString> &keys);
+    void recomputeProperties(void);
+    void updateHistory(DeviceObject *device, const QList <QString> &keys);
 
 public slots:
 
@@ -69,8 +103,15 @@ private slots:
     void mqttReceived(const QByteArray &message, const QMqttTopicName &topic) override;
 
     void updateProperties(void);
+    void republishProperties(void);
+    void updateSharding(void);
+    void handleMessage(const QByteArray &message, const QMqttTopicName &topic);
+    void publishOutbound(const QString &topic, const QList <outboundStruct> &list);
+    void pollDevice(const Binding &binding);
+    void pollStatus(DeviceObject *device, bool online);
 
     void devicetUpdated(DeviceObject *device);
+    void statusUpdated(const QByteArray &status);
     void addSubscription(const QString &topic, bool resubscribe);
 
 };
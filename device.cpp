@@ -1,29 +1,26 @@
+#include <QtConcurrent>
 #include "controller.h"
 #include "device.h"
 #include "expose.h"
 #include "logger.h"
 
-DeviceList::DeviceList(QSettings *config, QObject *parent) : QObject(parent), m_databaseTimer(new QTimer(this)), m_propertiesTimer(new QTimer(this)), m_sync(false)
+DeviceList::DeviceList(QSettings *config, QObject *parent) : QObject(parent), m_databaseTimer(new QTimer(this)), m_propertiesTimer(new QTimer(this)), m_databaseWatcher(new QFutureWatcher <databaseStruct> (this)), m_propertiesWatcher(new QFutureWatcher <bool> (this)), m_sync(false), m_shutdown(false)
 {
-    QFile file(config->value("device/expose", reinterpret_cast <HOMEd*> (parent)->basePath().append("share/homed-common/expose.json")).toString());
-
     ExposeObject::registerMetaTypes();
 
+    m_exposeFile.setFileName(config->value("device/expose", reinterpret_cast <HOMEd*> (parent)->basePath().append("share/homed-common/expose.json")).toString());
     m_databaseFile.setFileName(config->value("device/database", "/opt/homed-custom/database.json").toString());
     m_propertiesFile.setFileName(config->value("device/properties", "/opt/homed-custom/properties.json").toString());
 
     m_names = config->value("mqtt/names", false).toBool();
-
-    if (file.open(QFile::ReadOnly))
-    {
-        m_exposeOptions = QJsonDocument::fromJson(file.readAll()).object().toVariantMap();
-        file.close();
-    }
-
     m_specialExposes = {"switch", "lock", "light", "cover", "thermostat"};
 
+    loadExposes();
+
     connect(m_databaseTimer, &QTimer::timeout, this, &DeviceList::writeDatabase);
     connect(m_propertiesTimer, &QTimer::timeout, this, &DeviceList::writeProperties);
+    connect(m_databaseWatcher, &QFutureWatcher <databaseStruct>::finished, this, &DeviceList::databaseStored);
+    connect(m_propertiesWatcher, &QFutureWatcher <bool>::finished, this, [this] () { if (!m_propertiesWatcher->result()) logWarning << "Properties not stored"; });
 
     m_databaseTimer->setSingleShot(true);
     m_propertiesTimer->setSingleShot(true);
@@ -31,7 +28,11 @@ DeviceList::DeviceList(QSettings *config, QObject *parent) : QObject(parent), m_
 
 DeviceList::~DeviceList(void)
 {
+    m_databaseWatcher->waitForFinished();
+    m_propertiesWatcher->waitForFinished();
+
     m_sync = true;
+    m_shutdown = true;
 
     writeDatabase();
     writeProperties();
@@ -53,81 +54,267 @@ Device DeviceList::byName(const QString &name, int *index)
     return Device();
 }
 
-Device DeviceList::parse(const QJsonObject &json, const QString &service)
+Device DeviceList::create(const QJsonObject &json, const QString &service)
 {
-    QString id = mqttSafe(json.value("id").toString());
-    QJsonArray exposes = json.value("exposes").toArray();
-    QJsonObject bindings = json.value("bindings").toObject();
+    QString id = mqttSafe(json.value("id").toString()), name = mqttSafe(json.value("name").toString()), availabilityTopic = json.value("availabilityTopic").toString(), availabilityPattern = json.value("availabilityPattern").toString();
+    Profile profile = m_profiles.value(json.value("profile").toString());
+    QJsonArray array = json.value("exposes").toArray();
+    QJsonObject bindings = json.value("bindings").toObject(), computed = json.value("computed").toObject();
+    QMap <QString, QVariant> parameters = json.value("parameters").toObject().toVariantMap(), options;
+    QList <QString> exposes;
     Device device;
     Endpoint endpoint;
 
-    if (!id.isEmpty() && !exposes.isEmpty())
+    for (auto it = array.begin(); it != array.end(); it++)
+        exposes.append(it->toString());
+
+    if (!profile.isNull())
+    {
+        parameters.insert("id", id);
+        parameters.insert("name", name.isEmpty() ? id : name);
+
+        if (exposes.isEmpty())
+            exposes = profile->exposes();
+
+        if (!json.contains("availabilityTopic"))
+            availabilityTopic = substitute(profile->json().value("availabilityTopic").toString(), parameters);
+
+        if (!json.contains("availabilityPattern"))
+            availabilityPattern = substitute(profile->json().value("availabilityPattern").toString(), parameters);
+
+        options = array.isEmpty() && json.value("options").toObject().isEmpty() ? profile->resolvedOptions() : profile->options();
+    }
+
+    if (id.isEmpty() || exposes.isEmpty())
+        return device;
+
+    if (json.contains("active") && !json.value("active").toBool())
     {
-        device = Device(new DeviceObject(id, json.value("service").toString(service), json.value("availabilityTopic").toString(), json.value("availabilityPattern").toString(), mqttSafe(json.value("name").toString())));
+        QJsonObject data = json;
+
+        device = Device(new DeviceObject(id, json.value("service").toString(service), QString(), QString(), name));
         endpoint = Endpoint(new EndpointObject(DEFAULT_ENDPOINT, device));
 
-        if (json.contains("active"))
-            device->setActive(json.value("active").toBool());
+        data.insert("id", id);
 
-        if (json.contains("discovery"))
-            device->setDiscovery(json.value("discovery").toBool());
+        if (!name.isEmpty())
+            data.insert("name", name);
 
-        if (json.contains("cloud"))
-            device->setCloud(json.value("cloud").toBool());
+        if (!device->service().isEmpty())
+            data.insert("service", device->service());
 
+        device->setActive(false);
+        device->setLazy(true);
         device->setNote(json.value("note").toString());
-        device->setReal(json.value("real").toBool());
-        device->options() = json.value("options").toObject().toVariantMap();
+        device->setReal(json.contains("real") || profile.isNull() ? json.value("real").toBool() : profile->json().value("real").toBool());
+        device->setProfile(profile);
+        device->parameters() = json.value("parameters").toObject().toVariantMap();
+        device->storedJson() = data;
         device->endpoints().insert(endpoint->id(), endpoint);
 
-        for (auto it = exposes.begin(); it != exposes.end(); it++)
-        {
-            QString exposeName = it->toString(), itemName = exposeName.split('_').value(0);
-            QMap <QString, QVariant> option = m_exposeOptions.value(itemName).toMap();
-            Expose expose;
-            int type;
+        return device;
+    }
 
-            if (device->options().contains(exposeName))
-                option.insert(device->options().value(exposeName).toMap());
-            else if (device->options().contains(itemName))
-                option.insert(device->options().value(itemName).toMap());
+    device = Device(new DeviceObject(id, json.value("service").toString(service), availabilityTopic, availabilityPattern, name));
+    endpoint = Endpoint(new EndpointObject(DEFAULT_ENDPOINT, device));
 
-            if (!option.isEmpty())
-                device->options().insert(exposeName, option);
+    if (json.contains("active"))
+        device->setActive(json.value("active").toBool());
 
-            type = QMetaType::type(QString(m_specialExposes.contains(itemName) ? itemName : option.value("type").toString()).append("Expose").toUtf8());
+    if (json.contains("discovery"))
+        device->setDiscovery(json.value("discovery").toBool());
 
-            expose = Expose(type ? reinterpret_cast <ExposeObject*> (QMetaType::create(type)) : new ExposeObject(exposeName));
-            expose->setName(exposeName);
-            expose->setParent(endpoint.data());
+    if (json.contains("cloud"))
+        device->setCloud(json.value("cloud").toBool());
 
-            endpoint->exposes().append(expose);
-        }
+    if (!json.value("options").toObject().isEmpty())
+    {
+        QMap <QString, QVariant> data = json.value("options").toObject().toVariantMap();
 
-        for (auto it = bindings.begin(); it != bindings.end(); it++)
+        for (auto it = data.constBegin(); it != data.constEnd(); it++)
         {
-            QJsonObject item = it.value().toObject();
-            Binding binding(new BindingObject(item.value("inTopic").toString(), item.value("inPattern").toString(), item.value("outTopic").toString(), item.value("outPattern").toString(), item.value("retain").toBool()));
+            QMap <QString, QVariant> option = options.value(it.key(), options.value(it.key().split('_').value(0))).toMap();
 
-            if (binding->inTopic().isEmpty() && binding->outTopic().isEmpty())
+            if (option.isEmpty() || it.value().type() != QVariant::Map)
+            {
+                options.insert(it.key(), it.value());
                 continue;
+            }
 
-            if (!binding->inTopic().isEmpty())
-                emit addSubscription(binding->inTopic());
-
-            endpoint->bindings().insert(it.key(), binding);
+            option.insert(it.value().toMap());
+            options.insert(it.key(), option);
         }
+    }
+
+    device->setNote(json.value("note").toString());
+    device->setReal(json.contains("real") || profile.isNull() ? json.value("real").toBool() : profile->json().value("real").toBool());
+    device->setProfile(profile);
+    device->parameters() = json.value("parameters").toObject().toVariantMap();
+    device->options() = options;
+    device->endpoints().insert(endpoint->id(), endpoint);
+
+    for (int i = 0; i < exposes.count(); i++)
+    {
+        QString exposeName = exposes.at(i), itemName = exposeName.split('_').value(0);
+        auto descriptor = m_exposes.constFind(itemName);
+        QMap <QString, QVariant> option = descriptor != m_exposes.constEnd() ? descriptor->options : QMap <QString, QVariant> ();
+        Expose expose;
+        int type;
+
+        if (device->options().contains(exposeName))
+            option.insert(device->options().value(exposeName).toMap());
+        else if (device->options().contains(itemName))
+            option.insert(device->options().value(itemName).toMap());
+
+        if (!option.isEmpty() && device->options().value(exposeName).toMap() != option)
+            device->options().insert(exposeName, option);
+
+        type = descriptor != m_exposes.constEnd() && option.value("type") == descriptor->options.value("type") ? descriptor->type : exposeType(itemName, option.value("type").toString());
 
-        if (!device->availabilityTopic().isEmpty())
-            emit addSubscription(device->availabilityTopic(), true);
+        expose = Expose(type ? reinterpret_cast <ExposeObject*> (QMetaType::create(type)) : new ExposeObject(exposeName));
+        expose->setName(exposeName);
+        expose->setParent(endpoint.data());
+
+        endpoint->exposes().append(expose);
+    }
+
+    if (!profile.isNull())
+        for (auto it = profile->bindings().begin(); it != profile->bindings().end(); it++)
+            endpoint->bindings().insert(it.key(), profileBinding(it.value(), parameters));
+
+    for (auto it = bindings.begin(); it != bindings.end(); it++)
+    {
+        Binding binding = parseBinding(it.value().toObject());
+
+        if (binding.isNull())
+            continue;
 
-        connect(device->timer(), &QTimer::timeout, this, &DeviceList::deviceTimeout);
-        device->timer()->setSingleShot(true);
+        endpoint->bindings().insert(it.key(), binding);
     }
 
+    for (auto it = computed.begin(); it != computed.end(); it++)
+    {
+        QString pattern = it.value().toString();
+
+        if (pattern.isEmpty())
+            continue;
+
+        endpoint->computed().insert(it.key(), Computed(new ComputedObject(pattern)));
+    }
+
+    for (auto it = device->options().constBegin(); it != device->options().constEnd(); it++)
+    {
+        int depth = it.value().toMap().value("history").toInt();
+
+        if (depth <= 0)
+            continue;
+
+        endpoint->history().insert(it.key(), History(new HistoryObject(depth)));
+    }
+
+    for (auto it = endpoint->bindings().begin(); it != endpoint->bindings().end(); it++)
+    {
+        if (it.value()->history() <= 0)
+            continue;
+
+        endpoint->history().insert(it.key(), History(new HistoryObject(it.value()->history())));
+    }
+
+    device->storedOptions() = serializeOptions(device);
+    device->storedJson() = serializeDevice(device);
+
+    return device;
+}
+
+Device DeviceList::parse(const QJsonObject &json, const QString &service)
+{
+    Device device = create(json, service);
+
+    if (!device.isNull())
+        attach(device);
+
     return device;
 }
 
+void DeviceList::attach(const Device &device)
+{
+    const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+
+    if (device->lazy())
+        return;
+
+    for (auto it = endpoint->bindings().begin(); it != endpoint->bindings().end(); it++)
+        if (!it.value()->inTopic().isEmpty())
+            emit addSubscription(it.value()->inTopic());
+
+    if (!device->availabilityTopic().isEmpty())
+        emit addSubscription(device->availabilityTopic(), true);
+
+    connect(device->timer(), &QTimer::timeout, this, &DeviceList::deviceTimeout);
+    device->timer()->setSingleShot(true);
+}
+
+void DeviceList::copyState(const Device &device, const Device &other)
+{
+    const Endpoint &source = device->endpoints().value(DEFAULT_ENDPOINT), &target = other->endpoints().value(DEFAULT_ENDPOINT);
+
+    target->properties() = source->properties();
+
+    for (auto it = target->history().begin(); it != target->history().end(); it++)
+    {
+        const History &history = source->history().value(it.key());
+
+        if (history.isNull() || history->depth() != it.value()->depth())
+            continue;
+
+        it.value() = history;
+    }
+}
+
+bool DeviceList::updateProfile(const QString &name, const QJsonObject &json)
+{
+    QJsonArray exposes = json.value("exposes").toArray();
+    QJsonObject bindings = json.value("bindings").toObject();
+    Profile profile;
+
+    if (name.isEmpty() || json.isEmpty())
+        return false;
+
+    profile = Profile(new ProfileObject(name, json));
+    profile->options() = json.value("options").toObject().toVariantMap();
+
+    for (auto it = exposes.begin(); it != exposes.end(); it++)
+        profile->exposes().append(it->toString());
+
+    profile->resolvedOptions() = resolveOptions(profile->exposes(), profile->options());
+
+    for (auto it = bindings.begin(); it != bindings.end(); it++)
+    {
+        Binding binding = parseBinding(it.value().toObject());
+
+        if (binding.isNull())
+            continue;
+
+        profile->bindings().insert(it.key(), binding);
+    }
+
+    m_profiles.insert(name, profile);
+    return true;
+}
+
+bool DeviceList::removeProfile(const QString &name)
+{
+    if (!m_profiles.contains(name))
+        return false;
+
+    for (int i = 0; i < count(); i++)
+        if (!at(i)->profile().isNull() && at(i)->profile()->name() == name)
+            return false;
+
+    m_profiles.remove(name);
+    return true;
+}
+
 void DeviceList::init(void)
 {
     QJsonObject json;
@@ -136,7 +323,9 @@ void DeviceList::init(void)
         return;
 
     json = QJsonDocument::fromJson(m_databaseFile.readAll()).object();
+    unserializeProfiles(json.value("profiles").toObject());
     unserializeDevices(json.value("devices").toArray());
+    updateDependencies();
 
     m_databaseFile.close();
 
@@ -147,6 +336,223 @@ void DeviceList::init(void)
     m_propertiesFile.close();
 }
 
+bool DeviceList::reload(QList <QPair <Device, Device>> &list)
+{
+    QFile file(m_databaseFile.fileName());
+    QJsonParseError error;
+    QSet <QString> exposes, profiles, ids;
+    QMap <QString, int> index;
+    QJsonObject json;
+    QJsonArray devices;
+
+    m_databaseWatcher->waitForFinished();
+
+    if (!file.open(QFile::ReadOnly))
+    {
+        logWarning << "Database file" << file.fileName() << "open failed";
+        return false;
+    }
+
+    json = QJsonDocument::fromJson(file.readAll(), &error).object();
+    file.close();
+
+    if (error.error != QJsonParseError::NoError)
+    {
+        logWarning << "Database file" << file.fileName() << "parse error:" << error.errorString();
+        return false;
+    }
+
+    if (!loadExposes(&exposes))
+        return false;
+
+    profiles = loadProfiles(json.value("profiles").toObject());
+    devices = json.value("devices").toArray();
+
+    for (int i = 0; i < count(); i++)
+        index.insert(at(i)->id(), i);
+
+    for (auto it = devices.begin(); it != devices.end(); it++)
+    {
+        QJsonObject item = it->toObject();
+        QString id = mqttSafe(item.value("id").toString());
+        Device device, other;
+
+        if (id.isEmpty() || ids.contains(id))
+            continue;
+
+        ids.insert(id);
+
+        if (!index.contains(id))
+        {
+            if (!byName(id).isNull() || !byName(item.value("name").toString()).isNull())
+            {
+                logWarning << "Device" << id << "reload failed, identifier or name already in use";
+                continue;
+            }
+
+            device = parse(item);
+
+            if (device.isNull())
+                continue;
+
+            append(device);
+            list.append({Device(), device});
+            continue;
+        }
+
+        device = at(index.value(id));
+
+        if (device->storedJson() == item && !affected(device, exposes, profiles))
+            continue;
+
+        other = byName(item.value("name").toString());
+
+        if (!other.isNull() && other != device)
+        {
+            logWarning << device << "reload failed, name already in use";
+            continue;
+        }
+
+        other = parse(item, device->service());
+
+        if (other.isNull())
+        {
+            logWarning << device << "reload failed, data is incomplete";
+            continue;
+        }
+
+        copyState(device, other);
+        replace(index.value(id), other);
+        list.append({device, other});
+    }
+
+    for (int i = count() - 1; i >= 0; i--)
+    {
+        if (ids.contains(at(i)->id()))
+            continue;
+
+        list.append({at(i), Device()});
+        removeAt(i);
+    }
+
+    return true;
+}
+
+void DeviceList::updateDependencies(void)
+{
+    QRegExp regexp("(^|[\\s\\{'])property\\.([^\\s'\\{\\}]+)");
+    QMap <QString, Device> devices;
+    QMap <QString, QList <QString>> edges;
+    QMap <QString, int> index, low;
+    QList <QString> stack;
+    QSet <QString> active;
+    std::function <void (const QString&)> visit;
+
+    m_dependencies.clear();
+    m_circular.clear();
+
+    for (int i = 0; i < count(); i++)
+    {
+        devices.insert(at(i)->name(), at(i));
+        devices.insert(at(i)->id(), at(i));
+    }
+
+    for (int i = 0; i < count(); i++)
+    {
+        const Device &device = at(i);
+        const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+
+        for (auto it = endpoint->computed().begin(); it != endpoint->computed().end(); it++)
+        {
+            const Computed &computed = it.value();
+            int position = 0;
+
+            computed->references().clear();
+
+            while ((position = regexp.indexIn(computed->pattern(), position)) != -1)
+            {
+                QString reference = regexp.cap(2);
+                int index = reference.lastIndexOf('.');
+                Device source = index < 0 ? device : devices.value(reference.left(index));
+
+                position += regexp.matchedLength();
+
+                if (source.isNull())
+                    continue;
+
+                computed->references().insert(reference, {source, reference.mid(index + 1)});
+                m_dependencies[QString("%1/%2").arg(source->id(), reference.mid(index + 1))].append({device, it.key()});
+            }
+        }
+    }
+
+    for (auto it = m_dependencies.begin(); it != m_dependencies.end(); it++)
+        for (int i = 0; i < it.value().count(); i++)
+            edges[it.key()].append(QString("%1/%2").arg(it.value().at(i).device.toStrongRef()->id(), it.value().at(i).property));
+
+    visit = [&] (const QString &node)
+    {
+        QList <QString> list = edges.value(node);
+        int number = index.count();
+
+        index.insert(node, number);
+        low.insert(node, number);
+        stack.append(node);
+        active.insert(node);
+
+        for (int i = 0; i < list.count(); i++)
+        {
+            const QString &next = list.at(i);
+
+            if (next == node)
+                m_circular.insert(node);
+
+            if (!index.contains(next))
+            {
+                visit(next);
+                low.insert(node, qMin(low.value(node), low.value(next)));
+            }
+            else if (active.contains(next))
+                low.insert(node, qMin(low.value(node), index.value(next)));
+        }
+
+        if (low.value(node) != number)
+            return;
+
+        if (stack.last() != node)
+        {
+            QString item;
+
+            do
+            {
+                item = stack.takeLast();
+                active.remove(item);
+                m_circular.insert(item);
+            }
+            while (item != node);
+
+            return;
+        }
+
+        active.remove(stack.takeLast());
+    };
+
+    for (auto it = m_dependencies.begin(); it != m_dependencies.end(); it++)
+        if (!index.contains(it.key()))
+            visit(it.key());
+
+    if (m_circular.isEmpty())
+        return;
+
+    for (auto it = m_circular.begin(); it != m_circular.end(); it++)
+        logWarning << "Computed property" << *it << "has circular reference and will not be updated";
+
+    for (auto it = m_dependencies.begin(); it != m_dependencies.end(); it++)
+        for (int i = it.value().count() - 1; i >= 0; i--)
+            if (m_circular.contains(QString("%1/%2").arg(it.value().at(i).device.toStrongRef()->id(), it.value().at(i).property)))
+                it.value().removeAt(i);
+}
+
 void DeviceList::storeDatabase(bool sync)
 {
     if (sync)
@@ -160,29 +566,290 @@ void DeviceList::storeProperties(void)
     m_propertiesTimer->start(STORE_PROPERTIES_DELAY);
 }
 
+bool DeviceList::loadExposes(QSet <QString> *changed)
+{
+    QMap <QString, QVariant> exposeOptions = m_exposeOptions;
+    QList <QString> list;
+
+    if (m_exposeFile.open(QFile::ReadOnly))
+    {
+        QJsonParseError error;
+        QJsonObject json = QJsonDocument::fromJson(m_exposeFile.readAll(), &error).object();
+
+        m_exposeFile.close();
+
+        if (error.error != QJsonParseError::NoError)
+        {
+            logWarning << "Expose file" << m_exposeFile.fileName() << "parse error:" << error.errorString();
+            return false;
+        }
+
+        m_exposeOptions = json.toVariantMap();
+    }
+
+    list = exposeOptions.keys() + m_exposeOptions.keys();
+
+    if (changed)
+        for (int i = 0; i < list.count(); i++)
+            if (exposeOptions.value(list.at(i)) != m_exposeOptions.value(list.at(i)))
+                changed->insert(list.at(i));
+
+    updateExposes();
+
+    for (auto it = m_profiles.begin(); it != m_profiles.end(); it++)
+        it.value()->resolvedOptions() = resolveOptions(it.value()->exposes(), it.value()->options());
+
+    return true;
+}
+
+QSet <QString> DeviceList::loadProfiles(const QJsonObject &profiles)
+{
+    QSet <QString> changed;
+
+    for (auto it = m_profiles.begin(); it != m_profiles.end(); it++)
+        if (it.value()->json() != profiles.value(it.key()).toObject())
+            changed.insert(it.key());
+
+    for (auto it = profiles.begin(); it != profiles.end(); it++)
+        if (!m_profiles.contains(it.key()))
+            changed.insert(it.key());
+
+    m_profiles.clear();
+    unserializeProfiles(profiles);
+
+    return changed;
+}
+
+bool DeviceList::affected(const Device &device, const QSet <QString> &exposes, const QSet <QString> &profiles)
+{
+    const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+
+    if (!device->profile().isNull() && profiles.contains(device->profile()->name()))
+        return true;
+
+    for (int i = 0; i < endpoint->exposes().count(); i++)
+        if (exposes.contains(endpoint->exposes().at(i)->name().split('_').value(0)))
+            return true;
+
+    return false;
+}
+
+void DeviceList::updateExposes(void)
+{
+    QList <QString> list = m_exposeOptions.keys() + m_specialExposes;
+
+    m_exposes.clear();
+
+    for (int i = 0; i < list.count(); i++)
+    {
+        QMap <QString, QVariant> options = m_exposeOptions.value(list.at(i)).toMap();
+        m_exposes.insert(list.at(i), {exposeType(list.at(i), options.value("type").toString()), options});
+    }
+}
+
+int DeviceList::exposeType(const QString &itemName, const QString &type)
+{
+    return QMetaType::type(QString(m_specialExposes.contains(itemName) ? itemName : type).append("Expose").toUtf8());
+}
+
+Binding DeviceList::parseBinding(const QJsonObject &json)
+{
+    Binding binding(new BindingObject(json.value("inTopic").toString(), json.value("inPattern").toString(), json.value("outTopic").toString(), json.value("outPattern").toString(), json.value("retain").toBool(), json.value("history").toInt()));
+    QJsonObject poll = json.value("poll").toObject();
+
+    if (binding->inTopic().isEmpty() && binding->outTopic().isEmpty())
+        return Binding();
+
+    if (!binding->outTopic().isEmpty() && poll.value("interval").toInt() > 0)
+        binding->poll() = {poll.value("interval").toInt(), poll.value("timeout").toInt(), poll.value("pattern").toString()};
+
+    return binding;
+}
+
+Binding DeviceList::profileBinding(const Binding &binding, const QMap <QString, QVariant> &parameters)
+{
+    QString inTopic = substitute(binding->inTopic(), parameters), inPattern = substitute(binding->inPattern(), parameters), outTopic = substitute(binding->outTopic(), parameters), outPattern = substitute(binding->outPattern(), parameters), pollPattern = substitute(binding->poll().pattern, parameters);
+    Binding item;
+
+    if (inTopic == binding->inTopic() && inPattern == binding->inPattern() && outTopic == binding->outTopic() && outPattern == binding->outPattern() && pollPattern == binding->poll().pattern)
+        return binding;
+
+    item = Binding(new BindingObject(inTopic, inPattern, outTopic, outPattern, binding->retain(), binding->history()));
+    item->poll() = {binding->poll().interval, binding->poll().timeout, pollPattern};
+
+    return item;
+}
+
+QJsonObject DeviceList::serializeBinding(const Binding &binding)
+{
+    QJsonObject json;
+
+    if (!binding->inTopic().isEmpty())
+    {
+        if (!binding->inPattern().isEmpty())
+            json.insert("inPattern", binding->inPattern());
+
+        json.insert("inTopic", binding->inTopic());
+    }
+
+    if (!binding->outTopic().isEmpty())
+    {
+        if (!binding->outPattern().isEmpty())
+            json.insert("outPattern", binding->outPattern());
+
+        if (binding->retain())
+            json.insert("retain", binding->retain());
+
+        if (binding->poll().interval > 0)
+        {
+            QJsonObject poll = {{"interval", binding->poll().interval}};
+
+            if (!binding->poll().pattern.isEmpty())
+                poll.insert("pattern", binding->poll().pattern);
+
+            if (binding->poll().timeout > 0)
+                poll.insert("timeout", binding->poll().timeout);
+
+            json.insert("poll", poll);
+        }
+
+        json.insert("outTopic", binding->outTopic());
+    }
+
+    if (!json.isEmpty() && binding->history() > 0)
+        json.insert("history", binding->history());
+
+    return json;
+}
+
+QMap <QString, QVariant> DeviceList::resolveOptions(const QList <QString> &exposes, const QMap <QString, QVariant> &options)
+{
+    QMap <QString, QVariant> result = options;
+
+    for (int i = 0; i < exposes.count(); i++)
+    {
+        QString exposeName = exposes.at(i), itemName = exposeName.split('_').value(0);
+        QMap <QString, QVariant> option = m_exposes.value(itemName).options;
+
+        if (result.contains(exposeName))
+            option.insert(result.value(exposeName).toMap());
+        else if (result.contains(itemName))
+            option.insert(result.value(itemName).toMap());
+
+        if (option.isEmpty())
+            continue;
+
+        result.insert(exposeName, option);
+    }
+
+    return result;
+}
+
+QString DeviceList::substitute(const QString &string, const QMap <QString, QVariant> &parameters)
+{
+    QRegExp regexp("\\{\\{\\s*device\\.(\\w+)\\s*\\}\\}");
+    QString result = string;
+    int position = 0;
+
+    if (!string.contains("device."))
+        return string;
+
+    while ((position = regexp.indexIn(result, position)) != -1)
+    {
+        QString value;
+
+        if (!parameters.contains(regexp.cap(1)))
+        {
+            position += regexp.matchedLength();
+            continue;
+        }
+
+        value = parameters.value(regexp.cap(1)).toString();
+        result.replace(position, regexp.matchedLength(), value);
+        position += value.length();
+    }
+
+    return result;
+}
+
+QMap <QString, QVariant> DeviceList::deviceParameters(const Device &device)
+{
+    QMap <QString, QVariant> parameters = device->parameters();
+    parameters.insert("id", device->id());
+    parameters.insert("name", device->name());
+    return parameters;
+}
+
+void DeviceList::unserializeProfiles(const QJsonObject &profiles)
+{
+    quint16 count = 0;
+
+    for (auto it = profiles.begin(); it != profiles.end(); it++)
+    {
+        if (!updateProfile(it.key(), it.value().toObject()))
+            continue;
+
+        count++;
+    }
+
+    if (count)
+        logInfo << count << "profiles loaded";
+}
+
 void DeviceList::unserializeDevices(const QJsonArray &devices)
 {
+    QThread *thread = this->thread();
+    std::function <Device (const QJsonObject&)> worker;
+    QList <QJsonObject> list;
+    QList <Device> result;
+    QSet <QString> names;
+    QElapsedTimer timer;
     quint16 count = 0;
 
     for (auto it = devices.begin(); it != devices.end(); it++)
-    {
-        QJsonObject json = it->toObject();
-        Device device;
+        list.append(it->toObject());
 
-        if (!byName(json.value("id").toString()).isNull() || !byName(json.value("name").toString()).isNull())
-            continue;
+    for (int i = 0; i < size(); i++)
+    {
+        names.insert(at(i)->id());
+        names.insert(at(i)->name());
+    }
 
-        device = parse(json);
+    worker = [this, thread] (const QJsonObject &json)
+    {
+        Device device = create(json);
 
         if (device.isNull())
+            return device;
+
+        for (auto it = device->endpoints().begin(); it != device->endpoints().end(); it++)
+            it.value()->moveToThread(thread);
+
+        device->moveToThread(thread);
+        return device;
+    };
+
+    timer.start();
+    result = QtConcurrent::blockingMapped <QList <Device>> (list, worker);
+
+    for (int i = 0; i < result.count(); i++)
+    {
+        const QJsonObject &json = list.at(i);
+        const Device &device = result.at(i);
+
+        if (names.contains(json.value("id").toString()) || names.contains(json.value("name").toString()) || device.isNull())
             continue;
 
+        names.insert(device->id());
+        names.insert(device->name());
+
+        attach(device);
         append(device);
         count++;
     }
 
     if (count)
-        logInfo << count << "devices loaded";
+        logInfo << count << "devices loaded in" << timer.elapsed() << "ms";
 }
 
 void DeviceList::unserializeProperties(const QJsonObject &properties)
@@ -205,116 +872,176 @@ void DeviceList::unserializeProperties(const QJsonObject &properties)
         logInfo << "Properties restored";
 }
 
-QJsonArray DeviceList::serializeDevices(void)
+QJsonObject DeviceList::serializeDevice(const Device &device)
 {
-    QJsonArray array;
+    if (device->lazy())
+        return device->storedJson();
 
-    for (int i = 0; i < count(); i++)
+    const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+    const Profile &profile = device->profile();
+    QMap <QString, QVariant> parameters = deviceParameters(device);
+    QJsonObject json, options = device->storedOptions(), bindings, computed;
+    QList <QString> list;
+    QJsonArray exposes;
+
+    for (auto it = endpoint->bindings().begin(); it != endpoint->bindings().end(); it++)
     {
-        const Device &device = at(i);
-        const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
-        QJsonObject json, options, bindings;
-        QJsonArray exposes;
+        QJsonObject binding = serializeBinding(it.value());
 
-        for (auto it = device->options().begin(); it != device->options().end(); it++)
-        {
-            QString expose = it.key().split('_').value(0);
-            QMap <QString, QVariant> option, map;
-            QJsonObject data;
+        if (binding.isEmpty() || (!profile.isNull() && profile->bindings().contains(it.key()) && serializeBinding(profileBinding(profile->bindings().value(it.key()), parameters)) == binding))
+            continue;
 
-            if (it.value().type() != QVariant::Map)
-            {
-                options.insert(it.key(), QJsonValue::fromVariant(it.value()));
-                continue;
-            }
+        bindings.insert(it.key(), binding);
+    }
 
-            option = m_exposeOptions.value(expose).toMap();
-            map = it.value().toMap();
+    for (int i = 0; i < endpoint->exposes().count(); i++)
+        list.append(endpoint->exposes().at(i)->name());
 
-            for (auto it = option.begin(); it != option.end(); it++)
-                if (map.value(it.key()) == it.value())
-                    map.remove(it.key());
+    if (profile.isNull() || profile->exposes() != list)
+        for (int i = 0; i < list.count(); i++)
+            exposes.append(list.at(i));
 
-            data = QJsonObject::fromVariantMap(map);
+    json.insert("id", device->id());
+    json.insert("real", device->real());
+    json.insert("active", device->active());
+    json.insert("discovery", device->discovery());
+    json.insert("cloud", device->cloud());
 
-            if (map.isEmpty() || (it.key().contains('_') && options.value(expose) == data))
-                continue;
+    if (device->name() != device->id())
+        json.insert("name", device->name());
 
-            options.insert(it.key(), data);
-        }
+    if (!device->service().isEmpty())
+        json.insert("service", device->service());
 
-        for (auto it = endpoint->bindings().begin(); it != endpoint->bindings().end(); it++)
-        {
-            QJsonObject binding;
+    if (!profile.isNull())
+    {
+        if (!device->parameters().isEmpty())
+            json.insert("parameters", QJsonObject::fromVariantMap(device->parameters()));
 
-            if (!it.value()->inTopic().isEmpty())
-            {
-                if (!it.value()->inPattern().isEmpty())
-                    binding.insert("inPattern", it.value()->inPattern());
+        json.insert("profile", profile->name());
+    }
 
-                binding.insert("inTopic", it.value()->inTopic());
-            }
+    if (!device->availabilityTopic().isEmpty() && (profile.isNull() || device->availabilityTopic() != substitute(profile->json().value("availabilityTopic").toString(), parameters)))
+        json.insert("availabilityTopic", device->availabilityTopic());
 
-            if (!it.value()->outTopic().isEmpty())
-            {
-                if (!it.value()->outPattern().isEmpty())
-                    binding.insert("outPattern", it.value()->outPattern());
+    if (!device->availabilityPattern().isEmpty() && (profile.isNull() || device->availabilityPattern() != substitute(profile->json().value("availabilityPattern").toString(), parameters)))
+        json.insert("availabilityPattern", device->availabilityPattern());
 
-                if (it.value()->retain())
-                    binding.insert("retain", it.value()->retain());
+    if (!device->note().isEmpty())
+        json.insert("note", device->note());
 
-                binding.insert("outTopic", it.value()->outTopic());
-            }
+    if (!exposes.isEmpty())
+        json.insert("exposes", exposes);
 
-            if (binding.isEmpty())
-                continue;
+    if (!options.isEmpty())
+        json.insert("options", options);
+
+    if (!bindings.isEmpty())
+        json.insert("bindings", bindings);
+
+    for (auto it = endpoint->computed().begin(); it != endpoint->computed().end(); it++)
+        computed.insert(it.key(), it.value()->pattern());
+
+    if (!computed.isEmpty())
+        json.insert("computed", computed);
+
+    return json;
+}
+
+QJsonObject DeviceList::serializeOptions(const Device &device)
+{
+    const Profile &profile = device->profile();
+    QJsonObject options;
 
-            bindings.insert(it.key(), binding);
+    for (auto it = device->options().constBegin(); it != device->options().constEnd(); it++)
+    {
+        QString expose = it.key().split('_').value(0);
+        QMap <QString, QVariant> option, map;
+        QJsonObject data;
+
+        if (it.value().type() != QVariant::Map)
+        {
+            options.insert(it.key(), QJsonValue::fromVariant(it.value()));
+            continue;
         }
 
-        for (int i = 0; i < endpoint->exposes().count(); i++)
-            exposes.append(endpoint->exposes().at(i)->name());
+        option = m_exposes.value(expose).options;
+        map = it.value().toMap();
 
-        json.insert("id", device->id());
-        json.insert("real", device->real());
-        json.insert("active", device->active());
-        json.insert("discovery", device->discovery());
-        json.insert("cloud", device->cloud());
+        for (auto it = option.begin(); it != option.end(); it++)
+            if (map.value(it.key()) == it.value())
+                map.remove(it.key());
 
-        if (device->name() != device->id())
-            json.insert("name", device->name());
+        data = QJsonObject::fromVariantMap(map);
 
-        if (!device->service().isEmpty())
-            json.insert("service", device->service());
+        if (map.isEmpty() || (it.key().contains('_') && options.value(expose) == data))
+            continue;
 
-        if (!device->availabilityTopic().isEmpty())
-            json.insert("availabilityTopic", device->availabilityTopic());
+        options.insert(it.key(), data);
+    }
 
-        if (!device->availabilityPattern().isEmpty())
-            json.insert("availabilityPattern", device->availabilityPattern());
+    if (profile.isNull())
+        return options;
 
-        if (!device->note().isEmpty())
-            json.insert("note", device->note());
+    for (auto it = profile->options().constBegin(); it != profile->options().constEnd(); it++)
+    {
+        QJsonValue value = options.value(it.key());
+        QJsonObject data, option;
 
-        if (!exposes.isEmpty())
-            json.insert("exposes", exposes);
+        if (value == QJsonValue::fromVariant(it.value()))
+        {
+            options.remove(it.key());
+            continue;
+        }
 
-        if (!options.isEmpty())
-            json.insert("options", options);
+        if (!value.isObject() || it.value().type() != QVariant::Map)
+            continue;
+
+        data = value.toObject();
+        option = QJsonObject::fromVariantMap(it.value().toMap());
 
-        if (!bindings.isEmpty())
-            json.insert("bindings", bindings);
+        for (auto item = option.constBegin(); item != option.constEnd(); item++)
+            if (data.value(item.key()) == item.value())
+                data.remove(item.key());
 
-        array.append(json);
+        if (data.isEmpty())
+            options.remove(it.key());
+        else
+            options.insert(it.key(), data);
     }
 
-    return array;
+    return options;
 }
 
-QJsonObject DeviceList::serializeProperties(void)
+QJsonObject DeviceList::serializeProfiles(void)
 {
     QJsonObject json;
 
+    for (auto it = m_profiles.begin(); it != m_profiles.end(); it++)
+        json.insert(it.key(), it.value()->json());
+
+    return json;
+}
+
+QList <QJsonObject> DeviceList::serializeDevices(bool filter)
+{
+    QList <QJsonObject> list;
+
+    for (int i = 0; i < count(); i++)
+    {
+        if (filter && m_filter && !m_filter(at(i).data()))
+            continue;
+
+        list.append(at(i)->storedJson());
+    }
+
+    return list;
+}
+
+QMap <QString, QVariant> DeviceList::serializeProperties(void)
+{
+    QMap <QString, QVariant> map;
+
     for (int i = 0; i < count(); i++)
     {
         const Device &device = at(i);
@@ -323,26 +1050,92 @@ QJsonObject DeviceList::serializeProperties(void)
         if (endpoint->properties().isEmpty())
             continue;
 
-        json.insert(device->id(), QJsonObject::fromVariantMap(endpoint->properties()));
+        map.insert(device->id(), endpoint->properties());
     }
 
-    return json;
+    return map;
 }
 
 void DeviceList::writeDatabase(void)
 {
     HOMEd *homed = reinterpret_cast <HOMEd*> (parent());
-    QJsonObject json = {{"devices", serializeDevices()}, {"names", m_names}, {"timestamp", QDateTime::currentSecsSinceEpoch()}, {"version", SERVICE_VERSION}};
+    QList <QJsonObject> devices, status;
+    QJsonObject profiles;
+    qint64 timestamp = QDateTime::currentSecsSinceEpoch();
+    bool names = m_names, sync = m_sync;
+    std::function <databaseStruct (void)> store;
+    databaseStruct result;
+
+    if (m_databaseWatcher->isRunning())
+    {
+        m_databaseTimer->start(STORE_DATABASE_DELAY);
+        return;
+    }
 
-    homed->mqttPublishStatus(json);
+    devices = serializeDevices();
+    status = m_filter ? serializeDevices(true) : devices;
 
-    if (!m_sync)
-        return;
+    if (!m_profiles.isEmpty())
+        profiles = serializeProfiles();
 
-    json.remove("names");
     m_sync = false;
 
-    if (homed->writeFile(m_databaseFile, QJsonDocument(json).toJson(QJsonDocument::Compact)))
+    store = [this, homed, devices, status, profiles, timestamp, names, sync] ()
+    {
+        QJsonObject json = {{"names", names}, {"timestamp", timestamp}, {"version", SERVICE_VERSION}};
+        QJsonArray array;
+        databaseStruct result = {QByteArray(), true};
+
+        for (int i = 0; i < status.count(); i++)
+            array.append(status.at(i));
+
+        json.insert("devices", array);
+
+        if (!profiles.isEmpty())
+            json.insert("profiles", profiles);
+
+        result.status = QJsonDocument(json).toJson(QJsonDocument::Compact);
+
+        if (!sync)
+            return result;
+
+        if (status.count() != devices.count())
+        {
+            array = QJsonArray();
+
+            for (int i = 0; i < devices.count(); i++)
+                array.append(devices.at(i));
+
+            json.insert("devices", array);
+        }
+
+        json.remove("names");
+        result.stored = homed->writeFile(m_databaseFile, QJsonDocument(json).toJson(QJsonDocument::Compact));
+        return result;
+    };
+
+    if (!m_shutdown)
+    {
+        m_databaseWatcher->setFuture(QtConcurrent::run(store));
+        return;
+    }
+
+    result = store();
+    emit statusUpdated(result.status);
+
+    if (result.stored)
+        return;
+
+    logWarning << "Database not stored";
+}
+
+void DeviceList::databaseStored(void)
+{
+    databaseStruct result = m_databaseWatcher->result();
+
+    emit statusUpdated(result.status);
+
+    if (result.stored)
         return;
 
     logWarning << "Database not stored";
@@ -350,9 +1143,26 @@ void DeviceList::writeDatabase(void)
 
 void DeviceList::writeProperties(void)
 {
-    QJsonObject json = serializeProperties();
+    HOMEd *homed = reinterpret_cast <HOMEd*> (parent());
+    QMap <QString, QVariant> map;
+    std::function <bool (void)> store;
+
+    if (m_propertiesWatcher->isRunning())
+    {
+        m_propertiesTimer->start(STORE_PROPERTIES_DELAY);
+        return;
+    }
+
+    map = serializeProperties();
+    store = [this, homed, map] () { return homed->writeFile(m_propertiesFile, QJsonDocument(QJsonObject::fromVariantMap(map)).toJson(QJsonDocument::Compact)); };
+
+    if (!m_shutdown)
+    {
+        m_propertiesWatcher->setFuture(QtConcurrent::run(store));
+        return;
+    }
 
-    if (reinterpret_cast <HOMEd*> (parent())->writeFile(m_propertiesFile, QJsonDocument(json).toJson(QJsonDocument::Compact)))
+    if (store())
         return;
 
     logWarning << "Properties not stored";
@@ -5,18 +5,51 @@
 #define STORE_DATABASE_DELAY        20
 #define STORE_PROPERTIES_DELAY      1000
 
+#include <QFutureWatcher>
 #include "endpoint.h"
+#include "history.h"
 
 class BindingObject;
 typedef QSharedPointer <BindingObject> Binding;
 
+class ComputedObject;
+typedef QSharedPointer <ComputedObject> Computed;
+
+class ProfileObject;
+typedef QSharedPointer <ProfileObject> Profile;
+
+struct exposeStruct
+{
+    int type;
+    QMap <QString, QVariant> options;
+};
+
+struct pollStruct
+{
+    int interval;
+    int timeout;
+    QString pattern;
+};
+
+struct databaseStruct
+{
+    QByteArray status;
+    bool stored;
+};
+
+struct referenceStruct
+{
+    QWeakPointer <DeviceObject> device;
+    QString property;
+};
+
 class BindingObject
 {
 
 public:
 
-    BindingObject(const QString &inTopic, const QString &inPattern, const QString &outTopic, const QString &outPattern, bool retain) :
-        m_inTopic(inTopic), m_inPattern(inPattern), m_outTopic(outTopic), m_outPattern(outPattern), m_retain(retain) {}
+    BindingObject(const QString &inTopic, const QString &inPattern, const QString &outTopic, const QString &outPattern, bool retain, int history) :
+        m_inTopic(inTopic), m_inPattern(inPattern), m_outTopic(outTopic), m_outPattern(outPattern), m_retain(retain), m_history(history), m_poll({0, 0, QString()}) {}
 
     inline QString inTopic(void) { return m_inTopic; }
     inline QString inPattern(void) { return m_inPattern; }
@@ -24,11 +57,60 @@ public:
     inline QString outPattern(void) { return m_outPattern; }
 
     inline bool retain(void) { return m_retain; }
+    inline int history(void) { return m_history; }
+    inline pollStruct &poll(void) { return m_poll; }
 
 private:
 
     QString m_inTopic, m_inPattern, m_outTopic, m_outPattern;
     bool m_retain;
+    int m_history;
+    pollStruct m_poll;
+
+};
+
+class ComputedObject
+{
+
+public:
+
+    ComputedObject(const QString &pattern) :
+        m_pattern(pattern) {}
+
+    inline QString pattern(void) { return m_pattern; }
+    inline QMap <QString, referenceStruct> &references(void) { return m_references; }
+
+private:
+
+    QString m_pattern;
+    QMap <QString, referenceStruct> m_references;
+
+};
+
+class ProfileObject
+{
+
+public:
+
+    ProfileObject(const QString &name, const QJsonObject &json) :
+        m_name(name), m_json(json) {}
+
+    inline QString name(void) { return m_name; }
+    inline QJsonObject json(void) { return m_json; }
+
+    inline QList <QString> &exposes(void) { return m_exposes; }
+    inline QMap <QString, QVariant> &options(void) { return m_options; }
+    inline QMap <QString, QVariant> &resolvedOptions(void) { return m_resolvedOptions; }
+    inline QMap <QString, Binding> &bindings(void) { return m_bindings; }
+
+private:
+
+    QString m_name;
+    QJsonObject m_json;
+
+    QList <QString> m_exposes;
+    QMap <QString, QVariant> m_options, m_resolvedOptions;
+    QMap <QString, Binding> m_bindings;
 
 };
 
@@ -41,11 +123,15 @@ public:
         AbstractEndpointObject(id, device) {}
 
     inline QMap <QString, Binding> &bindings(void) { return m_bindings; }
+    inline QMap <QString, Computed> &computed(void) { return m_computed; }
+    inline QMap <QString, History> &history(void) { return m_history; }
     inline QMap <QString, QVariant> &properties(void) { return m_properties; }
 
 private:
 
     QMap <QString, Binding> m_bindings;
+    QMap <QString, Computed> m_computed;
+    QMap <QString, History> m_history;
     QMap <QString, QVariant> m_properties;
 
 };
@@ -56,7 +142,7 @@ class DeviceObject : public AbstractDeviceObject
 public:
 
     DeviceObject(const QString &id, const QString &service, const QString &availabilityTopic, const QString &availabilityPattern, const QString name) :
-        AbstractDeviceObject(name.isEmpty() ? id : name), m_timer(new QTimer(this)), m_id(id), m_service(service), m_availabilityTopic(availabilityTopic), m_availabilityPattern(availabilityPattern), m_real(false) {}
+        AbstractDeviceObject(name.isEmpty() ? id : name), m_timer(new QTimer(this)), m_id(id), m_service(service), m_availabilityTopic(availabilityTopic), m_availabilityPattern(availabilityPattern), m_real(false), m_lazy(false) {}
 
     inline QTimer *timer(void) { return m_timer; }
 
@@ -68,11 +154,25 @@ public:
     inline bool real(void) { return m_real; }
     inline void setReal(bool value) { m_real = value; }
 
+    inline bool lazy(void) { return m_lazy; }
+    inline void setLazy(bool value) { m_lazy = value; }
+
+    inline Profile profile(void) { return m_profile; }
+    inline void setProfile(const Profile &value) { m_profile = value; }
+
+    inline QMap <QString, QVariant> &parameters(void) { return m_parameters; }
+    inline QJsonObject &storedOptions(void) { return m_storedOptions; }
+    inline QJsonObject &storedJson(void) { return m_storedJson; }
+
 private:
 
     QTimer *m_timer;
     QString m_id, m_service, m_availabilityTopic, m_availabilityPattern;
-    bool m_real;
+    bool m_real, m_lazy;
+
+    Profile m_profile;
+    QMap <QString, QVariant> m_parameters;
+    QJsonObject m_storedOptions, m_storedJson;
 
 };
 
@@ -86,41 +186,83 @@ public:
     ~DeviceList(void);
 
     inline bool names(void) { return m_names; }
+    inline QMap <QString, QList <referenceStruct>> &dependencies(void) { return m_dependencies; }
+    inline QSet <QString> &circular(void) { return m_circular; }
+    inline void setFilter(const std::function <bool (DeviceObject*)> &value) { m_filter = value; }
 
     void init(void);
+    void updateDependencies(void);
     void storeDatabase(bool sync = false);
     void storeProperties(void);
 
     Device byName(const QString &name, int *index = nullptr);
     Device parse(const QJsonObject &json, const QString &service = QString());
+    void copyState(const Device &device, const Device &other);
+    bool reload(QList <QPair <Device, Device>> &list);
+
+    bool updateProfile(const QString &name, const QJsonObject &json);
+    bool removeProfile(const QString &name);
+
+    QJsonObject serializeDevice(const Device &device);
 
 private:
 
     QTimer *m_databaseTimer, *m_propertiesTimer;
+    QFutureWatcher <databaseStruct> *m_databaseWatcher;
+    QFutureWatcher <bool> *m_propertiesWatcher;
 
-    QFile m_databaseFile, m_propertiesFile;
-    bool m_names, m_sync;
+    QFile m_exposeFile, m_databaseFile, m_propertiesFile;
+    bool m_names, m_sync, m_shutdown;
 
     QMap <QString, QVariant> m_exposeOptions;
     QList <QString> m_specialExposes;
+    QMap <QString, exposeStruct> m_exposes;
+
+    QMap <QString, Profile> m_profiles;
+    QMap <QString, QList <referenceStruct>> m_dependencies;
+    QSet <QString> m_circular;
+    std::function <bool (DeviceObject*)> m_filter;
+
+    bool loadExposes(QSet <QString> *changed = nullptr);
+    QSet <QString> loadProfiles(const QJsonObject &profiles);
+    bool affected(const Device &device, const QSet <QString> &exposes, const QSet <QString> &profiles);
+
+    void updateExposes(void);
+    int exposeType(const QString &itemName, const QString &type);
+
+    Binding parseBinding(const QJsonObject &json);
+    Binding profileBinding(const Binding &binding, const QMap <QString, QVariant> &parameters);
+    QJsonObject serializeBinding(const Binding &binding);
+    QJsonObject serializeOptions(const Device &device);
+
+    Device create(const QJsonObject &json, const QString &service = QString());
+    void attach(const Device &device);
+
+    QMap <QString, QVariant> resolveOptions(const QList <QString> &exposes, const QMap <QString, QVariant> &options);
+    QString substitute(const QString &string, const QMap <QString, QVariant> &parameters);
+    QMap <QString, QVariant> deviceParameters(const Device &device);
 
+    void unserializeProfiles(const QJsonObject &profiles);
     void unserializeDevices(const QJsonArray &devices);
     void unserializeProperties(const QJsonObject &properties);
 
-    QJsonArray serializeDevices(void);
-    QJsonObject serializeProperties(void);
+    QJsonObject serializeProfiles(void);
+    QList <QJsonObject> serializeDevices(bool filter = false);
+    QMap <QString, QVariant> serializeProperties(void);
 
     bool writeFile(QFile &file, const QByteArray &data);
 
 private slots:
 
     void writeDatabase(void);
+    void databaseStored(void);
     void writeProperties(void);
     void deviceTimeout(void);
 
 signals:
 
     void devicetUpdated(DeviceObject *device);
+    void statusUpdated(const QByteArray &status);
     void addSubscription(const QString &topic, bool resubsctibe = false);
 
 };
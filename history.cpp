@@ -0,0 +1,106 @@
+#include <QDateTime>
+#include <QJsonArray>
+#include "history.h"
+
+void HistoryObject::append(const QVariant &value)
+{
+    historyStruct item = {static_cast <quint32> (QDateTime::currentSecsSinceEpoch()), 0};
+    double number;
+    bool check;
+
+    if (!value.isValid() || value.type() == QVariant::List || value.type() == QVariant::Map)
+        return;
+
+    number = value.toDouble(&check);
+
+    if (m_data.isEmpty())
+        m_type = value.type() == QVariant::Bool ? Type::boolean : check ? Type::number : Type::text;
+
+    if (m_type == Type::boolean)
+        item.value = value.toBool() ? 1 : 0;
+    else if (m_type == Type::text)
+    {
+        QString string = value.toString();
+        int index = m_strings.indexOf(string);
+
+        if (index < 0)
+        {
+            if (m_strings.count() >= HISTORY_MAX_STRINGS)
+                return;
+
+            index = m_strings.count();
+            m_strings.append(string);
+        }
+
+        item.value = index;
+    }
+    else
+    {
+        if (!check)
+            return;
+
+        item.value = number;
+    }
+
+    if (m_data.count() < m_depth)
+    {
+        m_data.append(item);
+        return;
+    }
+
+    m_data[m_index] = item;
+    m_index = (m_index + 1) % m_depth;
+}
+
+QJsonObject HistoryObject::query(quint32 start, quint32 end, quint32 interval)
+{
+    QJsonArray timestamps, values;
+    QJsonValue last;
+    quint32 bucket = 0;
+    double sum = 0;
+    int count = 0;
+
+    for (int i = 0; i < m_data.count(); i++)
+    {
+        const historyStruct &item = m_data.at((m_index + i) % m_data.count());
+        QJsonValue value;
+
+        if (item.time < start || item.time > end)
+            continue;
+
+        if (m_type == Type::boolean)
+            value = item.value != 0;
+        else if (m_type == Type::text)
+            value = m_strings.value(static_cast <int> (item.value));
+        else
+            value = item.value;
+
+        if (!interval)
+        {
+            timestamps.append(static_cast <qint64> (item.time));
+            values.append(value);
+            continue;
+        }
+
+        if (count && item.time - item.time % interval != bucket)
+        {
+            timestamps.append(static_cast <qint64> (bucket));
+            values.append(m_type != Type::number ? last : QJsonValue(sum / count));
+            sum = 0;
+            count = 0;
+        }
+
+        bucket = item.time - item.time % interval;
+        sum += item.value;
+        last = value;
+        count++;
+    }
+
+    if (count)
+    {
+        timestamps.append(static_cast <qint64> (bucket));
+        values.append(m_type != Type::number ? last : QJsonValue(sum / count));
+    }
+
+    return {{"timestamps", timestamps}, {"values", values}};
+}
@@ -0,0 +1,51 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#define HISTORY_MAX_DEPTH           10000
+#define HISTORY_MAX_STRINGS         256
+
+#include <QJsonObject>
+#include <QSharedPointer>
+#include <QVariant>
+#include <QVector>
+
+class HistoryObject;
+typedef QSharedPointer <HistoryObject> History;
+
+struct historyStruct
+{
+    quint32 time;
+    double value;
+};
+
+class HistoryObject
+{
+
+public:
+
+    enum class Type
+    {
+        number,
+        boolean,
+        text
+    };
+
+    HistoryObject(int depth) :
+        m_depth(qBound(1, depth, HISTORY_MAX_DEPTH)), m_index(0), m_type(Type::number) {}
+
+    inline int depth(void) { return m_depth; }
+
+    void append(const QVariant &value);
+    QJsonObject query(quint32 start, quint32 end, quint32 interval);
+
+private:
+
+    QVector <historyStruct> m_data;
+    QList <QString> m_strings;
+
+    int m_depth, m_index;
+    Type m_type;
+
+};
+
+#endif
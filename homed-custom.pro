@@ -2,10 +2,24 @@ include(../homed-common/homed-common.pri)
 include(../homed-common/homed-endpoint.pri)
 include(../homed-common/homed-parser.pri)
 
+QT += concurrent
+
 HEADERS += \
+    capture.h \
     controller.h \
-    device.h
+    device.h \
+    history.h \
+    inbound.h \
+    outbound.h \
+    poller.h \
+    sharding.h
 
 SOURCES += \
+    capture.cpp \
     controller.cpp \
-    device.cpp
+    device.cpp \
+    history.cpp \
+    inbound.cpp \
+    outbound.cpp \
+    poller.cpp \
+    sharding.cpp
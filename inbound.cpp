@@ -0,0 +1,114 @@
+#include "inbound.h"
+#include "logger.h"
+
+InboundQueue::InboundQueue(int size, int batch, int coalesce, QObject *parent) : QObject(parent), m_timer(new QTimer(this)), m_reportTimer(new QTimer(this)), m_size(size), m_batch(batch), m_coalesce(coalesce), m_sequence(0), m_coalesced(0), m_dropped(0), m_reported(0)
+{
+    connect(m_timer, &QTimer::timeout, this, &InboundQueue::update);
+    connect(m_reportTimer, &QTimer::timeout, this, &InboundQueue::report);
+
+    m_timer->setSingleShot(true);
+    m_reportTimer->start(INBOUND_REPORT_INTERVAL);
+    m_clock.start();
+}
+
+void InboundQueue::enqueue(Priority priority, const QByteArray &message, const QMqttTopicName &topic)
+{
+    inboundStruct item = {message, topic, m_clock.nsecsElapsed() / 1000};
+
+    if (priority == Priority::telemetry)
+    {
+        QString name = topic.name();
+
+        if (m_telemetry.count() >= m_coalesce && m_latest.contains(name))
+        {
+            m_telemetry[static_cast <int> (m_latest.value(name) - m_sequence)].message = message;
+            m_coalesced++;
+        }
+        else
+        {
+            if (m_telemetry.count() >= m_size)
+            {
+                takeTelemetry();
+                m_dropped++;
+            }
+
+            m_latest.insert(name, m_sequence + m_telemetry.count());
+            m_telemetry.append(item);
+        }
+    }
+    else
+    {
+        QList <inboundStruct> &queue = m_queues[static_cast <int> (priority)];
+
+        if (queue.count() >= m_size)
+        {
+            if (priority != Priority::availability)
+                logWarning << "Inbound queue overloaded, message on" << queue.first().topic.name() << "dropped";
+
+            queue.removeFirst();
+            m_dropped++;
+        }
+
+        queue.append(item);
+    }
+
+    if (m_timer->isActive())
+        return;
+
+    m_timer->start(0);
+}
+
+inboundStruct InboundQueue::takeTelemetry(void)
+{
+    inboundStruct item = m_telemetry.takeFirst();
+    QString name = item.topic.name();
+
+    if (m_latest.value(name) == m_sequence)
+        m_latest.remove(name);
+
+    m_sequence++;
+    return item;
+}
+
+bool InboundQueue::dequeue(inboundStruct &item)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (m_queues[i].isEmpty())
+            continue;
+
+        item = m_queues[i].takeFirst();
+        return true;
+    }
+
+    if (m_telemetry.isEmpty())
+        return false;
+
+    item = takeTelemetry();
+    return true;
+}
+
+void InboundQueue::update(void)
+{
+    inboundStruct item;
+
+    for (int i = 0; i < m_batch; i++)
+    {
+        if (!dequeue(item))
+            return;
+
+        emit message(item.message, item.topic);
+        emit dispatched(m_clock.nsecsElapsed() / 1000 - item.time);
+    }
+
+    m_timer->start(0);
+}
+
+void InboundQueue::report(void)
+{
+    if (m_coalesced + m_dropped == m_reported)
+        return;
+
+    m_reported = m_coalesced + m_dropped;
+    logWarning << "Inbound queue overloaded," << m_coalesced << "messages coalesced," << m_dropped << "messages dropped";
+}
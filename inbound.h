@@ -0,0 +1,64 @@
+#ifndef INBOUND_H
+#define INBOUND_H
+
+#define INBOUND_SIZE                1000
+#define INBOUND_BATCH               100
+#define INBOUND_COALESCE            100
+#define INBOUND_REPORT_INTERVAL     60000
+
+#include <QElapsedTimer>
+#include <QMqttTopicName>
+#include <QTimer>
+
+struct inboundStruct
+{
+    QByteArray message;
+    QMqttTopicName topic;
+    qint64 time;
+};
+
+class InboundQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    enum class Priority
+    {
+        service,
+        control,
+        availability,
+        telemetry
+    };
+
+    InboundQueue(int size, int batch, int coalesce, QObject *parent);
+
+    void enqueue(Priority priority, const QByteArray &message, const QMqttTopicName &topic);
+
+private:
+
+    QTimer *m_timer, *m_reportTimer;
+    QElapsedTimer m_clock;
+    int m_size, m_batch, m_coalesce;
+
+    QList <inboundStruct> m_queues[3], m_telemetry;
+    QHash <QString, quint64> m_latest;
+
+    quint64 m_sequence, m_coalesced, m_dropped, m_reported;
+
+    inboundStruct takeTelemetry(void);
+    bool dequeue(inboundStruct &item);
+
+private slots:
+
+    void update(void);
+    void report(void);
+
+signals:
+
+    void message(const QByteArray &message, const QMqttTopicName &topic);
+    void dispatched(qint64 latency);
+
+};
+
+#endif
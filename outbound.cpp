@@ -0,0 +1,115 @@
+#include "outbound.h"
+
+OutboundQueue::OutboundQueue(int delay, int interval, QObject *parent) : QObject(parent), m_timer(new QTimer(this)), m_delay(delay), m_interval(interval)
+{
+    connect(m_timer, &QTimer::timeout, this, &OutboundQueue::update);
+
+    m_timer->setSingleShot(true);
+    m_clock.start();
+}
+
+void OutboundQueue::enqueue(const QString &key, const Binding &binding, const QVariant &value)
+{
+    QString topic = binding->outTopic();
+    QList <outboundStruct> &list = m_items[topic];
+    qint64 time = m_clock.elapsed();
+    int index = -1;
+
+    for (int i = 0; i < list.count(); i++)
+    {
+        if (list.at(i).key != key)
+            continue;
+
+        index = i;
+        break;
+    }
+
+    if (index < 0)
+        list.append({key, binding, value});
+    else
+        list[index] = {key, binding, value};
+
+    if (m_due.contains(topic))
+        return;
+
+    m_due.insert(topic, m_last.contains(topic) ? qMax(time + m_delay, m_last.value(topic) + m_interval) : time + m_delay);
+    schedule();
+}
+
+void OutboundQueue::restore(const QString &topic, const QList <outboundStruct> &list)
+{
+    QList <outboundStruct> &items = m_items[topic];
+    qint64 time = m_clock.elapsed();
+
+    for (int i = list.count() - 1; i >= 0; i--)
+    {
+        bool check = true;
+
+        for (int j = 0; j < items.count(); j++)
+        {
+            if (items.at(j).key != list.at(i).key)
+                continue;
+
+            check = false;
+            break;
+        }
+
+        if (check)
+            items.prepend(list.at(i));
+    }
+
+    if (m_due.contains(topic))
+        return;
+
+    m_due.insert(topic, m_last.contains(topic) ? qMax(time + m_delay, m_last.value(topic) + m_interval) : time + m_delay);
+    schedule();
+}
+
+void OutboundQueue::schedule(void)
+{
+    qint64 due = -1;
+
+    for (auto it = m_due.begin(); it != m_due.end(); it++)
+        if (due < 0 || it.value() < due)
+            due = it.value();
+
+    if (due < 0)
+        return;
+
+    m_timer->start(static_cast <int> (qMax(due - m_clock.elapsed(), static_cast <qint64> (0))));
+}
+
+void OutboundQueue::update(void)
+{
+    qint64 time = m_clock.elapsed();
+    QList <QString> list;
+
+    for (auto it = m_last.begin(); it != m_last.end(); )
+    {
+        if (time - it.value() < m_interval)
+        {
+            it++;
+            continue;
+        }
+
+        it = m_last.erase(it);
+    }
+
+    for (auto it = m_due.begin(); it != m_due.end(); )
+    {
+        if (it.value() > time)
+        {
+            it++;
+            continue;
+        }
+
+        list.append(it.key());
+        m_last.insert(it.key(), time);
+        it = m_due.erase(it);
+    }
+
+    for (int i = 0; i < list.count(); i++)
+        emit publish(list.at(i), m_items.take(list.at(i)));
+
+    schedule();
+}
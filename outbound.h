@@ -0,0 +1,49 @@
+#ifndef OUTBOUND_H
+#define OUTBOUND_H
+
+#define OUTBOUND_DELAY              20
+#define OUTBOUND_INTERVAL           100
+
+#include <QElapsedTimer>
+#include "device.h"
+
+struct outboundStruct
+{
+    QString key;
+    Binding binding;
+    QVariant value;
+};
+
+class OutboundQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    OutboundQueue(int delay, int interval, QObject *parent);
+
+    void enqueue(const QString &key, const Binding &binding, const QVariant &value);
+    void restore(const QString &topic, const QList <outboundStruct> &list);
+
+private:
+
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    int m_delay, m_interval;
+
+    QMap <QString, QList <outboundStruct>> m_items;
+    QMap <QString, qint64> m_due, m_last;
+
+    void schedule(void);
+
+private slots:
+
+    void update(void);
+
+signals:
+
+    void publish(const QString &topic, const QList <outboundStruct> &list);
+
+};
+
+#endif
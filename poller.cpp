@@ -0,0 +1,143 @@
+#include <QRandomGenerator>
+#include "poller.h"
+
+Poller::Poller(int limit, QObject *parent) : QObject(parent), m_timer(new QTimer(this)), m_limit(qMax(limit, 1))
+{
+    connect(m_timer, &QTimer::timeout, this, &Poller::dispatch);
+
+    m_timer->setSingleShot(true);
+    m_clock.start();
+}
+
+void Poller::update(DeviceObject *device)
+{
+    const Endpoint &endpoint = device->endpoints().value(DEFAULT_ENDPOINT);
+
+    remove(device);
+
+    if (!device->active())
+        return;
+
+    for (auto it = endpoint->bindings().begin(); it != endpoint->bindings().end(); it++)
+    {
+        const Binding &binding = it.value();
+        QString key = QString("%1/%2").arg(device->id(), it.key());
+        qint64 due;
+
+        if (binding->poll().interval <= 0)
+            continue;
+
+        due = m_clock.elapsed() + QRandomGenerator::global()->bounded(binding->poll().interval * 1000);
+
+        m_items.insert(key, {device, binding, due});
+        m_devices[device->id()].append(key);
+        m_queue.insert(due, key);
+    }
+
+    schedule();
+}
+
+void Poller::remove(DeviceObject *device)
+{
+    QList <QString> list = m_devices.take(device->id());
+
+    for (int i = 0; i < list.count(); i++)
+    {
+        const QString &key = list.at(i);
+
+        m_queue.remove(m_items.value(key).due, key);
+        m_items.remove(key);
+        m_outstanding.remove(key);
+    }
+
+    m_offline.remove(device->id());
+}
+
+void Poller::received(DeviceObject *device, const QString &key)
+{
+    if (m_outstanding.isEmpty() && m_offline.isEmpty())
+        return;
+
+    if (m_outstanding.remove(QString("%1/%2").arg(device->id(), key)))
+        schedule();
+
+    if (!m_offline.remove(device->id()))
+        return;
+
+    emit statusChanged(device, true);
+}
+
+qint64 Poller::interval(const Binding &binding)
+{
+    int interval = binding->poll().interval * 1000, jitter = interval * POLL_JITTER / 100;
+    return jitter ? interval + QRandomGenerator::global()->bounded(-jitter, jitter) : interval;
+}
+
+void Poller::schedule(void)
+{
+    qint64 due = -1;
+
+    if (!m_queue.isEmpty() && m_outstanding.count() < m_limit)
+        due = m_queue.firstKey();
+
+    for (auto it = m_outstanding.begin(); it != m_outstanding.end(); it++)
+        if (due < 0 || it.value() < due)
+            due = it.value();
+
+    if (due < 0)
+    {
+        m_timer->stop();
+        return;
+    }
+
+    m_timer->start(static_cast <int> (qMax(due - m_clock.elapsed(), static_cast <qint64> (0))));
+}
+
+void Poller::dispatch(void)
+{
+    qint64 time = m_clock.elapsed();
+    QList <DeviceObject*> offline;
+    QList <Binding> list;
+
+    for (auto it = m_outstanding.begin(); it != m_outstanding.end(); )
+    {
+        const pollerStruct &item = m_items.value(it.key());
+
+        if (it.value() > time)
+        {
+            it++;
+            continue;
+        }
+
+        if (item.binding->poll().timeout > 0 && !item.device.isNull() && item.device->availabilityTopic().isEmpty() && !m_offline.contains(item.device->id()))
+        {
+            m_offline.insert(item.device->id());
+            offline.append(item.device.data());
+        }
+
+        it = m_outstanding.erase(it);
+    }
+
+    while (!m_queue.isEmpty() && m_queue.firstKey() <= time && m_outstanding.count() < m_limit)
+    {
+        QString key = m_queue.first();
+        pollerStruct &item = m_items[key];
+
+        m_queue.erase(m_queue.begin());
+
+        if (!item.binding->inTopic().isEmpty())
+            m_outstanding.insert(key, time + (item.binding->poll().timeout > 0 ? item.binding->poll().timeout : POLL_RESPONSE_TIMEOUT) * 1000);
+
+        item.due = time + interval(item.binding);
+        m_queue.insert(item.due, key);
+        list.append(item.binding);
+    }
+
+    schedule();
+
+    for (int i = 0; i < offline.count(); i++)
+        emit statusChanged(offline.at(i), false);
+
+    for (int i = 0; i < list.count(); i++)
+        emit poll(list.at(i));
+}
@@ -0,0 +1,57 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#define POLL_LIMIT                  10
+#define POLL_JITTER                 10
+#define POLL_RESPONSE_TIMEOUT       10
+
+#include <QElapsedTimer>
+#include <QPointer>
+#include "device.h"
+
+struct pollerStruct
+{
+    QPointer <DeviceObject> device;
+    Binding binding;
+    qint64 due;
+};
+
+class Poller : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    Poller(int limit, QObject *parent);
+
+    void update(DeviceObject *device);
+    void remove(DeviceObject *device);
+    void received(DeviceObject *device, const QString &key);
+
+private:
+
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    int m_limit;
+
+    QHash <QString, pollerStruct> m_items;
+    QHash <QString, QList <QString>> m_devices;
+    QMultiMap <qint64, QString> m_queue;
+    QHash <QString, qint64> m_outstanding;
+    QSet <QString> m_offline;
+
+    qint64 interval(const Binding &binding);
+    void schedule(void);
+
+private slots:
+
+    void dispatch(void);
+
+signals:
+
+    void poll(const Binding &binding);
+    void statusChanged(DeviceObject *device, bool online);
+
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include <QCryptographicHash>
+#include <QtEndian>
+#include "sharding.h"
+
+Sharding::Sharding(const QString &instance, const QList <QString> &instances, QObject *parent) : QObject(parent), m_instance(instance), m_instances(instances)
+{
+    m_online.insert(m_instance);
+    build();
+}
+
+bool Sharding::setStatus(const QString &instance, bool online)
+{
+    if (instance == m_instance || !m_instances.contains(instance) || m_online.contains(instance) == online)
+        return false;
+
+    if (online)
+        m_online.insert(instance);
+    else
+        m_online.remove(instance);
+
+    build();
+    return true;
+}
+
+bool Sharding::owns(const QString &id)
+{
+    auto it = m_ring.lowerBound(hash(id));
+
+    if (it == m_ring.end())
+        it = m_ring.begin();
+
+    return it.value() == m_instance;
+}
+
+quint32 Sharding::hash(const QString &string)
+{
+    return qFromBigEndian <quint32> (QCryptographicHash::hash(string.toUtf8(), QCryptographicHash::Md5).constData());
+}
+
+void Sharding::build(void)
+{
+    m_ring.clear();
+
+    for (auto it = m_online.begin(); it != m_online.end(); it++)
+    {
+        for (int i = 0; i < SHARDING_VIRTUAL_NODES; i++)
+        {
+            quint32 key = hash(QString("%1#%2").arg(*it).arg(i));
+
+            if (m_ring.contains(key) && m_ring.value(key) < *it)
+                continue;
+
+            m_ring.insert(key, *it);
+        }
+    }
+}
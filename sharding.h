@@ -0,0 +1,37 @@
+#ifndef SHARDING_H
+#define SHARDING_H
+
+#define SHARDING_DELAY              1000
+#define SHARDING_VIRTUAL_NODES      64
+
+#include <QMap>
+#include <QObject>
+#include <QSet>
+
+class Sharding : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    Sharding(const QString &instance, const QList <QString> &instances, QObject *parent);
+
+    inline QString instance(void) { return m_instance; }
+    inline QList <QString> instances(void) { return m_instances; }
+
+    bool setStatus(const QString &instance, bool online);
+    bool owns(const QString &id);
+
+private:
+
+    QString m_instance;
+    QList <QString> m_instances;
+    QSet <QString> m_online;
+    QMap <quint32, QString> m_ring;
+
+    quint32 hash(const QString &string);
+    void build(void);
+
+};
+
+#endif